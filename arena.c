@@ -0,0 +1,139 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT sizeof(double)
+
+static ArenaChunk* new_chunk(Arena* arena, size_t minimum);
+
+/* Push a new chunk large enough for minimum bytes in front of the list */
+static ArenaChunk* new_chunk(Arena* arena, size_t minimum) {
+    size_t size = ARENA_DEFAULT_CHUNK_SIZE;
+    ArenaChunk* chunk;
+
+    if (arena->head != NULL && arena->head->size * 2 > size) {
+        size = arena->head->size * 2;
+    }
+    while (size < minimum) size *= 2;
+
+    chunk = malloc(offsetof(ArenaChunk, data) + size);
+    if (chunk == NULL) return NULL;
+
+    chunk->next = arena->head;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->head = chunk;
+    return chunk;
+}
+
+void arena_init(Arena* arena) {
+    arena->head = NULL;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    ArenaChunk* chunk = arena->head;
+    size_t start;
+
+    if (chunk != NULL) {
+        start = (chunk->used + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+        if (start + size <= chunk->size) {
+            chunk->used = start + size;
+            return chunk->data + start;
+        }
+    }
+
+    chunk = new_chunk(arena, size);
+    if (chunk == NULL) return NULL;
+    chunk->used = size;
+    return chunk->data;
+}
+
+char* arena_strndup(Arena* arena, const char* text, size_t length) {
+    char* copy = arena_alloc(arena, length + 1);
+    if (copy == NULL) return NULL;
+
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+char* arena_extend(Arena* arena, char* block, size_t used, size_t extra) {
+    ArenaChunk* chunk = arena->head;
+    char* moved;
+
+    if (block == NULL) {
+        return arena_alloc(arena, extra);
+    }
+
+    /* In place when the block is still the top of the current chunk */
+    if (chunk != NULL && block + used == chunk->data + chunk->used &&
+        chunk->used + extra <= chunk->size) {
+        chunk->used += extra;
+        return block;
+    }
+
+    chunk = new_chunk(arena, (used + extra) * 2);
+    if (chunk == NULL) return NULL;
+    moved = chunk->data;
+    memcpy(moved, block, used);
+    chunk->used = used + extra;
+    return moved;
+}
+
+void arena_adopt(Arena* arena, Arena* other) {
+    ArenaChunk* last = other->head;
+
+    if (last == NULL) return;
+    if (arena->head == NULL) {
+        arena->head = other->head;
+        other->head = NULL;
+        return;
+    }
+
+    /* The chunk being filled stays in front */
+    while (last->next != NULL) last = last->next;
+    last->next = arena->head->next;
+    arena->head->next = other->head;
+    other->head = NULL;
+}
+
+size_t arena_size(const Arena* arena) {
+    const ArenaChunk* chunk;
+    size_t size = 0;
+
+    for (chunk = arena->head; chunk != NULL; chunk = chunk->next) {
+        size += chunk->size;
+    }
+    return size;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaChunk* keep = arena->head;
+    ArenaChunk* chunk;
+    ArenaChunk* next;
+
+    if (keep == NULL) return;
+
+    /* Chunks adopted from another arena may be larger than the newest one */
+    for (chunk = keep->next; chunk != NULL; chunk = chunk->next) {
+        if (chunk->size > keep->size) keep = chunk;
+    }
+    for (chunk = arena->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        if (chunk != keep) free(chunk);
+    }
+    arena->head = keep;
+    keep->next = NULL;
+    keep->used = 0;
+}
+
+void arena_free(Arena* arena) {
+    ArenaChunk* chunk;
+    ArenaChunk* next;
+
+    for (chunk = arena->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena->head = NULL;
+}
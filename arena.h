@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+
+/* A block of arena memory; chunks are never moved once allocated */
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size;
+    size_t used;
+    char data[1];
+} ArenaChunk;
+
+/* Bump allocator. Allocations are only released all at once */
+typedef struct {
+    ArenaChunk* head;  /* Chunk currently being filled */
+} Arena;
+
+/* Initialize an empty arena, no memory is allocated until first use */
+void arena_init(Arena* arena);
+
+/* Allocate size bytes, aligned for any object. Returns NULL when out of memory */
+void* arena_alloc(Arena* arena, size_t size);
+
+/* Copy a string of the given length into the arena and null terminate it */
+char* arena_strndup(Arena* arena, const char* text, size_t length);
+
+/* Grow the most recent allocation (block with used bytes) by extra bytes.
+ * It grows in place when the chunk has room, otherwise it moves to a new
+ * chunk at least twice its size, so repeated appends are amortized O(1).
+ * Pass block NULL to start a new growable block. Returns the block */
+char* arena_extend(Arena* arena, char* block, size_t used, size_t extra);
+
+/* Move all memory of other into arena, leaving other empty. What was
+ * allocated from other stays valid for as long as arena keeps it */
+void arena_adopt(Arena* arena, Arena* other);
+
+/* Bytes of all chunks the arena holds */
+size_t arena_size(const Arena* arena);
+
+/* Release everything allocated but keep the largest chunk for reuse */
+void arena_reset(Arena* arena);
+
+/* Release all memory of the arena */
+void arena_free(Arena* arena);
+
+#endif /* ARENA_H */
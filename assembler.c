@@ -0,0 +1,295 @@
+#include "assembler.h"
+#include "first_pass.h"
+#include "parallel_pass.h"
+#include "second_pass.h"
+#include "object_writer.h"
+#include "cache.h"
+#include "source_reader.h"
+#include "scanner.h"
+#include <stdlib.h>
+#include <string.h>
+
+static char* make_file_name(const char* base, size_t base_length, const char* extension);
+static void count_file(AssemblerContext* context);
+static int assemble_named_source(AssemblerContext* context, const char* name, size_t base_length,
+                                 const SourceFile* source, const char* expanded_name);
+
+/* Build base + extension in a new buffer */
+static char* make_file_name(const char* base, size_t base_length, const char* extension) {
+    size_t extension_length = strlen(extension);
+    char* name = malloc(base_length + extension_length + 1);
+
+    if (name == NULL) return NULL;
+    memcpy(name, base, base_length);
+    memcpy(name + base_length, extension, extension_length + 1);
+    return name;
+}
+
+void init_context(AssemblerContext* context, const char* filename) {
+    scan_init();
+    context->IC = 100;
+    context->DC = 0;
+    init_symbol_table(&context->symbols);
+    init_macro_table(&context->macros);
+    init_diagnostics(&context->diagnostics, filename);
+    context->program.spans = NULL;
+    context->program.count = 0;
+    context->program.capacity = 0;
+    context->program.line_count = 0;
+    init_instructions(&context->instructions);
+    init_image(&context->image);
+    context->fixups.items = NULL;
+    context->fixups.count = context->fixups.capacity = 0;
+    context->entries.items = NULL;
+    context->entries.count = context->entries.capacity = 0;
+    context->externals.items = NULL;
+    context->externals.count = context->externals.capacity = 0;
+    context->output = NULL;
+    context->output_capacity = 0;
+    context->cache_dir = NULL;
+    context->thread_count = 1;
+    init_stats(&context->stats);
+}
+
+void reset_context(AssemblerContext* context) {
+    context->IC = 100;
+    context->DC = 0;
+    clear_symbol_table(&context->symbols);
+    clear_macro_table(&context->macros);
+    clear_diagnostics(&context->diagnostics);
+    context->program.count = 0;
+    context->instructions.count = 0;
+    clear_image(&context->image);
+    context->fixups.count = 0;
+    context->entries.count = 0;
+    context->externals.count = 0;
+}
+
+void free_context(AssemblerContext* context) {
+    free_symbol_table(&context->symbols);
+    free_macro_table(&context->macros);
+    free_diagnostics(&context->diagnostics);
+    free_expanded_source(&context->program);
+    free_instructions(&context->instructions);
+    free_image(&context->image);
+    free(context->fixups.items);
+    free(context->entries.items);
+    free(context->externals.items);
+    free(context->output);
+    context->output = NULL;
+    context->output_capacity = 0;
+    context->fixups.items = NULL;
+    context->fixups.count = context->fixups.capacity = 0;
+    context->entries.items = NULL;
+    context->entries.count = context->entries.capacity = 0;
+    context->externals.items = NULL;
+    context->externals.count = context->externals.capacity = 0;
+}
+
+int add_fixup(FixupList* list, int address, int symbol, int line_number) {
+    Fixup* fixup;
+
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        Fixup* grown = realloc(list->items, capacity * sizeof(Fixup));
+        if (grown == NULL) return 0;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+
+    fixup = &list->items[list->count++];
+    fixup->address = address;
+    fixup->symbol = symbol;
+    fixup->line_number = line_number;
+    return 1;
+}
+
+int add_reference(ReferenceList* list, const char* name, int address) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        SymbolReference* grown = realloc(list->items, capacity * sizeof(SymbolReference));
+        if (grown == NULL) return 0;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count].name = name;
+    list->items[list->count].address = address;
+    list->count++;
+    return 1;
+}
+
+/* Add the counters of the file just assembled to the statistics. The tables
+ * never shrink while a context is reused, so their size now is their peak */
+static void count_file(AssemblerContext* context) {
+    AssemblyStats* stats = &context->stats;
+    const MacroTable* macros = &context->macros;
+    const SymbolTable* symbols = &context->symbols;
+    size_t size;
+    int i;
+
+    stats->files++;
+    stats->lines_read += (unsigned long)context->program.line_count;
+    stats->macros_defined += (unsigned long)macros->count;
+    for (i = 0; i < context->program.count; i++) {
+        if (context->program.spans[i].macro >= 0) stats->macro_expansions++;
+        stats->bytes_expanded += (unsigned long)context->program.spans[i].length;
+    }
+    stats->symbols_inserted += (unsigned long)symbols->count;
+    stats->symbol_lookups += symbols->lookups;
+    stats->symbol_probes += symbols->probes;
+    stats->words_emitted += (unsigned long)(context->IC - 100 + context->DC);
+    stats->fixups += (unsigned long)context->fixups.count;
+
+    size = (size_t)symbols->capacity * sizeof(Symbol);
+    if (symbols->slots != NULL) size += ((size_t)symbols->slot_mask + 1) * sizeof(SymbolSlot);
+    if (size > stats->peak_symbol_bytes) stats->peak_symbol_bytes = size;
+
+    size = (size_t)macros->capacity * sizeof(Macro) + arena_size(&macros->arena);
+    if (macros->slots != NULL) size += ((size_t)macros->slot_mask + 1) * sizeof(MacroSlot);
+    if (size > stats->peak_macro_bytes) stats->peak_macro_bytes = size;
+
+    size = (size_t)context->program.capacity * sizeof(SourceSpan);
+    if (size > stats->peak_span_bytes) stats->peak_span_bytes = size;
+
+    size = (size_t)context->instructions.capacity * IR_INSTRUCTION_SIZE;
+    if (size > stats->peak_instruction_bytes) stats->peak_instruction_bytes = size;
+
+    size = (size_t)(context->image.code.capacity + context->image.data.capacity) * sizeof(MachineWord);
+    if (size > stats->peak_image_bytes) stats->peak_image_bytes = size;
+
+    size = (size_t)context->fixups.capacity * sizeof(Fixup);
+    if (size > stats->peak_fixup_bytes) stats->peak_fixup_bytes = size;
+}
+
+int assemble_source(AssemblerContext* context, const SourceFile* source, const char* expanded_name) {
+    double* seconds = context->stats.seconds;
+    double start = stats_clock();
+    double finish;
+    int expanded = expand_macros(&context->macros, &context->diagnostics, source, &context->program,
+                                 context->thread_count);
+
+    finish = stats_clock();
+    seconds[STATS_MACRO_COLLECTION] += context->macros.collect_seconds;
+    seconds[STATS_MACRO_EXPANSION] += finish - start - context->macros.collect_seconds;
+
+    if (!expanded) {
+        report_error(&context->diagnostics, 0, "Out of memory while expanding macros");
+    } else if (context->diagnostics.error_count == 0) {
+        if (expanded_name != NULL && !write_expanded_source(&context->program, expanded_name)) {
+            report_error(&context->diagnostics, 0, "Cannot write file %s", expanded_name);
+        }
+        start = stats_clock();
+        seconds[STATS_OUTPUT] += start - finish;
+
+        if (parallel_first_pass(context)) {
+            finish = stats_clock();
+        } else {
+            perform_first_pass(context, &context->program);
+            finish = stats_clock();
+            seconds[STATS_FIRST_PASS] += finish - start;
+
+            encode_program(context);
+            start = stats_clock();
+            seconds[STATS_ENCODING] += start - finish;
+            finish = start;
+        }
+
+        /* The data follows the code, where the first pass relocated its symbols */
+        if (!place_data(&context->image)) {
+            report_error(&context->diagnostics, 0, "Out of memory");
+        }
+
+        perform_second_pass(context);
+        seconds[STATS_SECOND_PASS] += stats_clock() - finish;
+    }
+    count_file(context);
+    return context->diagnostics.error_count == 0;
+}
+
+/* Assemble an open source and write the outputs of a file named
+ * name up to base_length, or restore them from the cache */
+static int assemble_named_source(AssemblerContext* context, const char* name, size_t base_length,
+                                 const SourceFile* source, const char* expanded_name) {
+    CacheKey key;
+
+    if (context->cache_dir != NULL) {
+        cache_key(&key, source->data, source->size);
+        if (cache_restore(context->cache_dir, &key, name, base_length)) {
+            context->stats.files++;
+            context->stats.cache_hits++;
+            return 1;
+        }
+    }
+
+    /* Object files are only written for a file without errors, and only
+     * such a file is cached. A failed cache store just means a miss later */
+    if (assemble_source(context, source, expanded_name)) {
+        double start = stats_clock();
+        int written = write_object_files(context, name, base_length);
+
+        if (written && context->cache_dir != NULL) {
+            cache_store(context->cache_dir, &key, context);
+        }
+        context->stats.seconds[STATS_OUTPUT] += stats_clock() - start;
+        if (context->output_capacity > context->stats.peak_output_bytes) {
+            context->stats.peak_output_bytes = context->output_capacity;
+        }
+    }
+    return context->diagnostics.error_count == 0;
+}
+
+int assemble_file(AssemblerContext* context, const char* name) {
+    size_t base_length = strlen(name);
+    char* source_name;
+    char* expanded_name;
+    SourceFile source;
+    int ok;
+
+    /* Accept both "prog" and "prog.as" */
+    if (base_length > 3 && strcmp(name + base_length - 3, ".as") == 0) {
+        base_length -= 3;
+    }
+    source_name = make_file_name(name, base_length, ".as");
+    expanded_name = make_file_name(name, base_length, ".am");
+    if (source_name == NULL || expanded_name == NULL) {
+        report_error(&context->diagnostics, 0, "Out of memory");
+        free(source_name);
+        free(expanded_name);
+        return 0;
+    }
+
+    if (!source_open(&source, source_name)) {
+        report_error(&context->diagnostics, 0, "Cannot open file %s", source_name);
+        free(source_name);
+        free(expanded_name);
+        return 0;
+    }
+
+    ok = assemble_named_source(context, name, base_length, &source, expanded_name);
+    source_close(&source);
+    free(source_name);
+    free(expanded_name);
+    return ok;
+}
+
+int assemble_file_contents(AssemblerContext* context, const char* name, const char* data, size_t size) {
+    size_t base_length = strlen(name);
+    char* expanded_name;
+    SourceFile source;
+    int ok;
+
+    if (base_length > 3 && strcmp(name + base_length - 3, ".as") == 0) {
+        base_length -= 3;
+    }
+    expanded_name = make_file_name(name, base_length, ".am");
+    if (expanded_name == NULL) {
+        report_error(&context->diagnostics, 0, "Out of memory");
+        return 0;
+    }
+
+    source_from_buffer(&source, data, size);
+    ok = assemble_named_source(context, name, base_length, &source, expanded_name);
+    free(expanded_name);
+    return ok;
+}
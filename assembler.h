@@ -0,0 +1,90 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include "encoder.h"
+#include "symbol_table.h"
+#include "macros.h"
+#include "diagnostics.h"
+#include "stats.h"
+#include "ir.h"
+#include "image.h"
+
+/* Part of every cache key, change it whenever the output format changes */
+#define ASSEMBLER_VERSION "1.2.4"
+
+/* A symbol handed back to callers, see assembler_api.h */
+typedef struct {
+    const char* name;
+    int address;
+} SymbolReference;
+
+/* Growable list of symbol references, e.g. the entries or the places
+ * where external symbols are used */
+typedef struct {
+    SymbolReference* items;
+    int count;
+    int capacity;
+} ReferenceList;
+
+/* A word that refers to a symbol, completed by the second pass */
+typedef struct {
+    int address;              /* Address of the word to patch */
+    int symbol;               /* Index in the symbol table */
+    int line_number;          /* Source line, for diagnostics */
+} Fixup;
+
+typedef struct FixupList {
+    Fixup* items;
+    int count;
+    int capacity;
+} FixupList;
+
+/* All state of assembling one file. Nothing is shared between contexts,
+ * so different files can be assembled at the same time */
+typedef struct AssemblerContext {
+    int IC;   /* Instruction Counter */
+    int DC;   /* Data Counter */
+    Image image;                /* Encoded code and data words */
+    SymbolTable symbols;
+    MacroTable macros;
+    Diagnostics diagnostics;
+    ExpandedSource program;     /* Spans of the last macro expansion */
+    InstructionList instructions; /* Instructions found by the first pass */
+    FixupList fixups;           /* Words waiting for a symbol address */
+    ReferenceList entries;      /* Entry symbols and their addresses */
+    ReferenceList externals;    /* Every use of an external symbol */
+    char* output;               /* Buffer the output files are formatted in */
+    size_t output_capacity;
+    const char* cache_dir;      /* Directory of cached outputs, NULL to always assemble */
+    int thread_count;           /* Threads the first pass of one file may use */
+    AssemblyStats stats;        /* Totals of every file assembled with the context */
+} AssemblerContext;
+
+void init_context(AssemblerContext* context, const char* filename);
+
+/* Forget everything about the last file but keep all allocations.
+ * The statistics keep adding up */
+void reset_context(AssemblerContext* context);
+
+void free_context(AssemblerContext* context);
+
+/* Record a word to patch with the address of a symbol, returns 0 if out of memory */
+int add_fixup(FixupList* list, int address, int symbol, int line_number);
+
+/* Append a symbol reference, returns 0 if out of memory */
+int add_reference(ReferenceList* list, const char* name, int address);
+
+/* Assemble a source that is already open. The expanded source is written
+ * to expanded_name unless it is NULL. Returns 1 if there were no errors */
+int assemble_source(AssemblerContext* context, const SourceFile* source, const char* expanded_name);
+
+/* Assemble one source file. The name may be given with or without
+ * the .as extension. With a cache_dir, the outputs of an unchanged source
+ * are restored from the cache instead. Returns 1 if there were no errors */
+int assemble_file(AssemblerContext* context, const char* name);
+
+/* Same as assemble_file, with the source already read into memory. The
+ * text is only used during the call */
+int assemble_file_contents(AssemblerContext* context, const char* name, const char* data, size_t size);
+
+#endif /* ASSEMBLER_H */
@@ -0,0 +1,42 @@
+#include "assembler_api.h"
+#include <stdlib.h>
+
+AssemblerContext* asm_context_create(void) {
+    AssemblerContext* context = malloc(sizeof(AssemblerContext));
+
+    if (context != NULL) {
+        init_context(context, "<buffer>");
+    }
+    return context;
+}
+
+int asm_assemble_buffer(AssemblerContext* context, const char* source, size_t length, AssemblyResult* result) {
+    SourceFile reader;
+
+    reset_context(context);
+    source_from_buffer(&reader, source, length);
+    assemble_source(context, &reader, NULL);
+
+    result->entries = context->entries.items;
+    result->entry_count = context->entries.count;
+    result->externals = context->externals.items;
+    result->external_count = context->externals.count;
+    result->words = context->image.code.words;
+    result->word_count = context->image.code.count;
+    format_diagnostics(&context->diagnostics);
+    result->messages = context->diagnostics.text;
+    result->messages_length = context->diagnostics.length;
+    result->error_count = context->diagnostics.error_count;
+    return result->error_count == 0;
+}
+
+void asm_context_reset(AssemblerContext* context) {
+    reset_context(context);
+}
+
+void asm_context_destroy(AssemblerContext* context) {
+    if (context != NULL) {
+        free_context(context);
+        free(context);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef ASSEMBLER_API_H
+#define ASSEMBLER_API_H
+
+#include <stddef.h>
+#include "assembler.h"
+
+/* What came out of assembling a buffer. All pointers refer to memory owned
+ * by the context and stay valid until it is reset, reused or destroyed */
+typedef struct {
+    const MachineWord* words;   /* Memory image, code then data, words[0] is address 100 */
+    int word_count;
+    const SymbolReference* entries;
+    int entry_count;
+    const SymbolReference* externals;   /* Every word that uses an external symbol */
+    int external_count;
+    const char* messages;       /* Error messages in line order, one per line, not null terminated */
+    size_t messages_length;
+    int error_count;
+} AssemblyResult;
+
+/* Create a context for assembling sources held in memory, NULL if out of memory */
+AssemblerContext* asm_context_create(void);
+
+/* Assemble a source held in memory. The context is reset first, so the
+ * result of the previous call is no longer valid.
+ * Returns 1 if the source was assembled without errors */
+int asm_assemble_buffer(AssemblerContext* context, const char* source, size_t length, AssemblyResult* result);
+
+/* Forget the last source but keep every allocation for the next one */
+void asm_context_reset(AssemblerContext* context);
+
+void asm_context_destroy(AssemblerContext* context);
+
+#endif /* ASSEMBLER_API_H */
@@ -0,0 +1,186 @@
+#include "batch.h"
+#include "assembler.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* One file of the batch and what came out of assembling it */
+typedef struct {
+    const char* name;
+    long size;
+    int succeeded;
+    Diagnostics diagnostics;
+} BatchJob;
+
+/* Jobs shared by the workers. Workers take the next job from order[],
+ * which lists the jobs from the biggest file to the smallest */
+typedef struct {
+    BatchJob** order;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+    const BatchOptions* options;
+    int threads_per_file;    /* Cores left to each worker for the first pass of a file */
+} BatchQueue;
+
+static long source_size(const char* name);
+static int compare_size(const void* a, const void* b);
+static void run_job(AssemblerContext* context, BatchJob* job);
+static void* worker_main(void* argument);
+
+int available_cores(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+/* Size of the source file of a job, used only for scheduling */
+static long source_size(const char* name) {
+    struct stat info;
+    size_t length = strlen(name);
+    char* source_name;
+    long size = 0;
+
+    if (length > 3 && strcmp(name + length - 3, ".as") == 0) {
+        return stat(name, &info) == 0 ? (long)info.st_size : 0;
+    }
+
+    source_name = malloc(length + 4);
+    if (source_name == NULL) return 0;
+    sprintf(source_name, "%s.as", name);
+    if (stat(source_name, &info) == 0) size = (long)info.st_size;
+    free(source_name);
+    return size;
+}
+
+/* Biggest first, so that a large file does not start last and finish late */
+static int compare_size(const void* a, const void* b) {
+    const BatchJob* first = *(const BatchJob* const*)a;
+    const BatchJob* second = *(const BatchJob* const*)b;
+
+    if (first->size != second->size) return first->size < second->size ? 1 : -1;
+    return first < second ? -1 : (first > second);
+}
+
+/* Assemble the file of a job and keep its messages for later printing */
+static void run_job(AssemblerContext* context, BatchJob* job) {
+    reset_context(context);
+    context->diagnostics.filename = job->name;
+    job->succeeded = assemble_file(context, job->name);
+
+    /* The job takes over the messages, the rest of the context is reused */
+    move_diagnostics(&job->diagnostics, &context->diagnostics);
+}
+
+static void* worker_main(void* argument) {
+    BatchQueue* queue = argument;
+    AssemblerContext* context = malloc(sizeof(AssemblerContext));
+    int index;
+
+    if (context == NULL) return NULL;
+    init_context(context, "");
+    context->cache_dir = queue->options->cache_dir;
+    context->thread_count = queue->threads_per_file;
+    context->diagnostics.max_errors = queue->options->max_errors;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->count) break;
+        run_job(context, queue->order[index]);
+    }
+
+    if (queue->options->stats != NULL) {
+        pthread_mutex_lock(&queue->lock);
+        merge_stats(queue->options->stats, &context->stats);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    free_context(context);
+    free(context);
+    return NULL;
+}
+
+int assemble_files(char* const* names, int count, const BatchOptions* options) {
+    int worker_count = options->worker_count;
+    BatchJob* jobs;
+    BatchQueue queue;
+    pthread_t* workers;
+    int started = 0;
+    int failed = 0;
+    int i;
+
+    if (count <= 0) return 0;
+
+    jobs = calloc((size_t)count, sizeof(BatchJob));
+    queue.order = malloc((size_t)count * sizeof(BatchJob*));
+    if (jobs == NULL || queue.order == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(jobs);
+        free(queue.order);
+        return count;
+    }
+
+    for (i = 0; i < count; i++) {
+        jobs[i].name = names[i];
+        jobs[i].size = source_size(names[i]);
+        init_diagnostics(&jobs[i].diagnostics, names[i]);
+        jobs[i].diagnostics.max_errors = options->max_errors;
+        queue.order[i] = &jobs[i];
+    }
+    qsort(queue.order, (size_t)count, sizeof(BatchJob*), compare_size);
+    queue.count = count;
+    queue.next = 0;
+    queue.options = options;
+
+    if (worker_count <= 0) worker_count = available_cores();
+    if (worker_count > count) worker_count = count;
+    queue.threads_per_file = available_cores() / worker_count;
+    if (queue.threads_per_file < 1) queue.threads_per_file = 1;
+
+    workers = malloc((size_t)worker_count * sizeof(pthread_t));
+    if (workers != NULL && worker_count > 1) {
+        pthread_mutex_init(&queue.lock, NULL);
+        for (started = 0; started < worker_count; started++) {
+            if (pthread_create(&workers[started], NULL, worker_main, &queue) != 0) break;
+        }
+        for (i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        pthread_mutex_destroy(&queue.lock);
+    }
+
+    /* Single worker, or threads could not be started: finish in this thread */
+    if (queue.next < count) {
+        pthread_mutex_init(&queue.lock, NULL);
+        worker_main(&queue);
+        pthread_mutex_destroy(&queue.lock);
+    }
+
+    /* Print in the order the files were given, not the order they finished */
+    for (i = 0; i < count; i++) {
+        if (!jobs[i].succeeded) failed++;
+        flush_diagnostics(&jobs[i].diagnostics, stderr);
+        free_diagnostics(&jobs[i].diagnostics);
+    }
+
+    free(workers);
+    free(queue.order);
+    free(jobs);
+    return failed;
+}
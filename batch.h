@@ -0,0 +1,23 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "stats.h"
+
+/* Get the number of processor cores available, at least 1 */
+int available_cores(void);
+
+/* Settings of a batch run */
+typedef struct {
+    int worker_count;        /* 0 uses one worker per core */
+    const char* cache_dir;   /* Directory of cached outputs, or NULL */
+    AssemblyStats* stats;    /* Receives the totals of all files, or NULL */
+    int max_errors;          /* Most messages printed for one file, 0 for no limit */
+} BatchOptions;
+
+/* Assemble several files at the same time on a pool of worker threads.
+ * The biggest files are started first. Messages of each file are printed
+ * together and in the order the files were given.
+ * Returns the number of files that had errors */
+int assemble_files(char* const* names, int count, const BatchOptions* options);
+
+#endif /* BATCH_H */
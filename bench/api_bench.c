@@ -0,0 +1,47 @@
+/* Measures the per-call cost of assembling small snippets through the
+ * library API with one reused context. */
+
+#include "../assembler_api.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define CALLS 200000L
+
+static const char snippet[] =
+        "macr twice\n"
+        "  inc r1\n"
+        "  inc r1\n"
+        "endmacr\n"
+        "MAIN: mov #5, r1\n"
+        "      twice\n"
+        "LOOP: cmp r1, #9\n"
+        "      bne LOOP\n"
+        "      prn r1\n"
+        "      stop\n";
+
+int main(void) {
+    AssemblerContext* context = asm_context_create();
+    AssemblyResult result;
+    long words = 0;
+    long i;
+    clock_t start;
+    double seconds;
+
+    if (context == NULL) return 1;
+
+    start = clock();
+    for (i = 0; i < CALLS; i++) {
+        asm_assemble_buffer(context, snippet, sizeof(snippet) - 1, &result);
+        words += result.word_count;
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%ld calls, %.2f us per call, %ld words\n", CALLS, seconds * 1e6 / CALLS, words);
+    if (result.error_count > 0) {
+        fwrite(result.messages, 1, result.messages_length, stderr);
+    }
+
+    asm_context_destroy(context);
+    return 0;
+}
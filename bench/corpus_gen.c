@@ -0,0 +1,190 @@
+/* Generates realistic assembly sources of a given size for the benchmarks.
+ * Usage: corpus_gen <lines> <output file> [lines per module]
+ *
+ * The corpus is a series of independent modules, each starting with a
+ * ";@module" comment line. A module defines two macros and then mixes
+ * labels, macro calls, every opcode with every addressing mode it accepts,
+ * .data and .string directives, comments and blank lines. Every module
+ * is small enough for operands to address all its labels, so a corpus of
+ * one module, up to about 1000 lines, is a valid source; larger ones can
+ * only be assembled module by module, but their macros can still be
+ * expanded as a whole. */
+
+#include "../image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Lines average under 3 words of the image, so the labels of a module of
+ * this many lines are always below ADDRESS_MAX */
+#define WORDS_PER_LINE 4
+#define MAX_MODULE_LINES ((ADDRESS_MAX + 1 - 100) / WORDS_PER_LINE)
+#define DEFAULT_MODULE_LINES MAX_MODULE_LINES
+#define LABEL_EVERY 8
+
+typedef struct {
+    const char* name;
+    int operands;
+    const char* sources;        /* Addressing modes: i(mmediate) d(irect) x (index) r(egister) */
+    const char* destinations;
+} Opcode;
+
+static const Opcode opcodes[] = {
+        {"mov", 2, "idxr", "dxr"}, {"cmp", 2, "idxr", "idxr"}, {"add", 2, "idxr", "dxr"},
+        {"sub", 2, "idxr", "dxr"}, {"lea", 2, "d", "dxr"},     {"clr", 1, "", "dxr"},
+        {"not", 1, "", "dxr"},     {"inc", 1, "", "dxr"},      {"dec", 1, "", "dxr"},
+        {"jmp", 1, "", "dx"},      {"bne", 1, "", "dx"},       {"red", 1, "", "dxr"},
+        {"prn", 1, "", "idxr"},    {"jsr", 1, "", "dx"},       {"rts", 0, "", ""},
+        {"stop", 0, "", ""}
+};
+
+static unsigned long random_state = 2463534242UL;
+
+/* xorshift, so the corpus is the same on every platform */
+static unsigned long next_random(void) {
+    random_state ^= (random_state << 13) & 0xFFFFFFFFUL;
+    random_state ^= random_state >> 17;
+    random_state ^= (random_state << 5) & 0xFFFFFFFFUL;
+    return random_state;
+}
+
+static int random_below(int limit) {
+    return (int)(next_random() % (unsigned long)limit);
+}
+
+static void write_operand(FILE* out, char mode, long module, int labels) {
+    switch (mode) {
+        case 'i': fprintf(out, "#%d", random_below(1001) - 500); break;
+        case 'd': fprintf(out, "L%ldx%d", module, random_below(labels)); break;
+        case 'x': fprintf(out, "*r%d", random_below(8)); break;
+        default: fprintf(out, "r%d", random_below(8)); break;
+    }
+}
+
+static void write_instruction(FILE* out, long module, int labels) {
+    const Opcode* opcode = &opcodes[random_below(16)];
+    const char* modes;
+
+    fprintf(out, "%s", opcode->name);
+    if (opcode->operands == 2) {
+        modes = opcode->sources;
+        fputc(' ', out);
+        write_operand(out, modes[random_below((int)strlen(modes))], module, labels);
+        fputc(',', out);
+    }
+    if (opcode->operands >= 1) {
+        modes = opcode->destinations;
+        fputc(' ', out);
+        write_operand(out, modes[random_below((int)strlen(modes))], module, labels);
+    }
+    fputc('\n', out);
+}
+
+/* At most 7 values, so that labelled lines stay within 80 characters */
+static void write_data(FILE* out) {
+    int count = 1 + random_below(7);
+    int i;
+
+    fprintf(out, ".data ");
+    for (i = 0; i < count; i++) {
+        fprintf(out, i == 0 ? "%d" : ", %d", random_below(32768) - 16384);
+    }
+    fputc('\n', out);
+}
+
+static void write_string(FILE* out) {
+    int length = 1 + random_below(24);
+    int i;
+
+    fprintf(out, ".string \"");
+    for (i = 0; i < length; i++) {
+        fputc('a' + random_below(26), out);
+    }
+    fprintf(out, "\"\n");
+}
+
+/* Write one module of the given number of lines, at least 10 */
+static void write_module(FILE* out, long module, int lines) {
+    int body = lines - 9;   /* Marker and two macro definitions of 4 lines */
+    int labels = (body + LABEL_EVERY - 1) / LABEL_EVERY;
+    int i, kind;
+
+    fprintf(out, ";@module %ld\n", module);
+    fprintf(out, "macr M%lda\n  inc r%d\n  prn #%d\nendmacr\n", module, random_below(8), random_below(100));
+    fprintf(out, "macr M%ldb\n  mov *r%d, r%d\n  bne L%ldx0\nendmacr\n", module, random_below(8), random_below(8), module);
+
+    for (i = 0; i < body; i++) {
+        kind = random_below(100);
+
+        /* Every LABEL_EVERY-th line carries a label, so only lines that
+         * can have one are put there */
+        if (i % LABEL_EVERY == 0) {
+            fprintf(out, "L%ldx%d: ", module, i / LABEL_EVERY);
+            if (kind < 80) {
+                write_instruction(out, module, labels);
+            } else if (kind < 93) {
+                write_data(out);
+            } else {
+                write_string(out);
+            }
+            continue;
+        }
+
+        if (kind < 66) {
+            fputc('\t', out);
+            write_instruction(out, module, labels);
+        } else if (kind < 74) {
+            fprintf(out, "\tM%ld%c\n", module, kind < 70 ? 'a' : 'b');
+        } else if (kind < 84) {
+            fputc('\t', out);
+            write_data(out);
+        } else if (kind < 88) {
+            fputc('\t', out);
+            write_string(out);
+        } else if (kind < 90) {
+            fprintf(out, ".entry L%ldx%d\n", module, random_below(labels));
+        } else if (kind < 95) {
+            fprintf(out, "; comment %d\n", i);
+        } else {
+            fputc('\n', out);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long total;
+    long written = 0;
+    long module = 0;
+    int module_lines = DEFAULT_MODULE_LINES;
+    int lines;
+    FILE* out;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <lines> <output file> [lines per module]\n", argv[0]);
+        return 1;
+    }
+    total = atol(argv[1]);
+    if (argc > 3) module_lines = atoi(argv[3]);
+    if (module_lines < 10) module_lines = 10;
+    if (module_lines > MAX_MODULE_LINES) module_lines = MAX_MODULE_LINES;
+
+    out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    while (written < total) {
+        lines = total - written < module_lines ? (int)(total - written) : module_lines;
+        if (lines < 10) lines = 10;
+        write_module(out, module++, lines);
+        written += lines;
+    }
+
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    printf("%s: %ld lines in %ld modules\n", argv[2], written, module);
+    return 0;
+}
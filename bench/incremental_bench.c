@@ -0,0 +1,78 @@
+/* Measures the latency of one-line edits in an incremental session over a
+ * large source, against loading the whole source again. */
+
+#include "../incremental.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LINES 100000
+#define EDITS 2000
+
+/* Edits alternate between these, so every other one changes the size */
+static const char* const replacements[] = {
+        "      mov r1, r2",
+        "      mov #7, LOOP0",
+        "      jmp LOOP1"
+};
+
+static char* make_source(size_t* length) {
+    char* source = malloc((size_t)LINES * 32);
+    char* out = source;
+    int i;
+
+    for (i = 0; i < LINES; i++) {
+        if (i % 10 == 0) {
+            out += sprintf(out, "LOOP%d: cmp r1, #%d\n", i / 10, i % 100);
+        } else if (i % 10 == 5) {
+            out += sprintf(out, "      bne LOOP%d\n", (i / 10 + 7) % (LINES / 10));
+        } else {
+            out += sprintf(out, "      inc r%d\n", i % 8);
+        }
+    }
+    *length = (size_t)(out - source);
+    return source;
+}
+
+int main(void) {
+    IncrementalSession* session = session_create();
+    AssemblyResult result;
+    size_t length;
+    char* source = make_source(&length);
+    const char* text;
+    clock_t start;
+    double load_seconds, edit_seconds, result_seconds = 0;
+    int line;
+    int i;
+
+    if (session == NULL) return 1;
+
+    start = clock();
+    session_load(session, source, length);
+    load_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    srand(1);
+    edit_seconds = 0;
+    for (i = 0; i < EDITS; i++) {
+        line = rand() % LINES;
+        if (line % 10 == 0) line++; /* Keep the labels */
+        text = replacements[i % 3];
+
+        start = clock();
+        session_edit(session, line, 1, text, strlen(text));
+        edit_seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        session_result(session, &result);
+        result_seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+    }
+
+    printf("%d lines: load %.1f ms, edit %.1f us, result %.1f us, %d words\n",
+           LINES, load_seconds * 1e3, edit_seconds * 1e6 / EDITS, result_seconds * 1e6 / EDITS,
+           result.word_count);
+
+    free(source);
+    session_destroy(session);
+    return 0;
+}
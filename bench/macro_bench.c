@@ -0,0 +1,88 @@
+/* Measures macro expansion throughput in lines per second for programs
+ * with different numbers of defined macros, with and without a parameter.
+ * Usage: macro_bench [threads] */
+
+#include "../macros.h"
+#include "../stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_LINES 1000000L
+#define CALL_EVERY 8
+
+/* Build a program that defines macro_total macros and then calls one of
+ * them on every CALL_EVERY-th line. Macros with a parameter are called
+ * with one of eight registers */
+static char* build_program(int macro_total, int parameter, size_t* size) {
+    size_t capacity = (size_t)PROGRAM_LINES * 24 + (size_t)macro_total * 64 + 1;
+    char* program = malloc(capacity);
+    size_t length = 0;
+    long i;
+
+    if (program == NULL) return NULL;
+
+    for (i = 0; i < macro_total; i++) {
+        if (parameter) {
+            length += sprintf(program + length, "macr m_%ld x\n  inc x\n  prn #%ld\nendmacr\n", i, i);
+        } else {
+            length += sprintf(program + length, "macr m_%ld\n  inc r%ld\n  prn #%ld\nendmacr\n", i, i % 8, i);
+        }
+    }
+    for (i = 0; i < PROGRAM_LINES; i++) {
+        if (macro_total > 0 && i % CALL_EVERY == 0 && parameter) {
+            length += sprintf(program + length, "m_%ld r%ld\n", (i / CALL_EVERY) % macro_total, i % 8);
+        } else if (macro_total > 0 && i % CALL_EVERY == 0) {
+            length += sprintf(program + length, "m_%ld\n", (i / CALL_EVERY) % macro_total);
+        } else {
+            length += sprintf(program + length, "L%ld: add r%ld, #%ld\n", i, i % 8, i % 100);
+        }
+    }
+
+    *size = length;
+    return program;
+}
+
+int main(int argc, char** argv) {
+    static const int macro_totals[] = {0, 10, 1000, 10, 1000};
+    static const int parameters[] = {0, 0, 0, 1, 1};
+    SourceFile source;
+    ExpandedSource program = {0};
+    MacroTable table;
+    Diagnostics diagnostics;
+    char* text;
+    size_t size;
+    double start, seconds;
+    int threads = argc > 1 ? atoi(argv[1]) : 1;
+    int m;
+
+    if (threads < 1) threads = 1;
+    printf("%8s %10s %14s %10s\n", "macros", "parameter", "lines/sec", "spans");
+
+    for (m = 0; m < (int)(sizeof(macro_totals) / sizeof(macro_totals[0])); m++) {
+        text = build_program(macro_totals[m], parameters[m], &size);
+        if (text == NULL) return 1;
+
+        source.data = text;
+        source.size = size;
+        source.position = 0;
+        source.line_number = 0;
+        source.is_mapped = 0;
+
+        init_macro_table(&table);
+        init_diagnostics(&diagnostics, "bench");
+
+        start = stats_clock();
+        if (!expand_macros(&table, &diagnostics, &source, &program, threads)) return 1;
+        seconds = stats_clock() - start;
+
+        printf("%8d %10s %14.0f %10d\n", macro_totals[m], parameters[m] ? "yes" : "no",
+               (PROGRAM_LINES + macro_totals[m] * 4) / (seconds > 0 ? seconds : 1e-9), program.count);
+
+        free_expanded_source(&program);
+        free_macro_table(&table);
+        free_diagnostics(&diagnostics);
+        free(text);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+/* Reports the throughput of each assembler phase on a corpus written by
+ * corpus_gen. Usage: phase_bench <corpus file>
+ *
+ * Every ";@module" section is assembled on its own with one reused
+ * context, the way a build assembles many files, and the time of each
+ * phase is summed over all modules. The output phase formats the object,
+ * entry and extern files in memory and writes them to /dev/null.
+ * A module has to fit in the memory image, but macro expansion does not,
+ * so it is also timed over the whole corpus at once */
+
+#include "../assembler.h"
+#include "../first_pass.h"
+#include "../second_pass.h"
+#include "../object_writer.h"
+#include "../source_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MODULE_MARKER ";@module"
+
+typedef struct {
+    const char* name;
+    double seconds;
+    double lines;
+    double bytes;
+} Phase;
+
+enum {
+    PHASE_EXPANSION, PHASE_FIRST_PASS, PHASE_ENCODING, PHASE_SECOND_PASS, PHASE_OUTPUT, PHASE_WHOLE_EXPANSION,
+    PHASE_COUNT
+};
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+/* Start of the next module after position, or the end of the corpus */
+static size_t next_module(const char* data, size_t size, size_t position) {
+    size_t marker = sizeof(MODULE_MARKER) - 1;
+    const char* found;
+
+    while (position < size) {
+        found = memchr(data + position, '\n', size - position);
+        if (found == NULL) return size;
+        position = (size_t)(found - data) + 1;
+        if (size - position >= marker && memcmp(data + position, MODULE_MARKER, marker) == 0) return position;
+    }
+    return size;
+}
+
+static size_t count_lines(const char* text, size_t length) {
+    const char* end = text + length;
+    size_t lines = 0;
+
+    while ((text = memchr(text, '\n', (size_t)(end - text))) != NULL) {
+        lines++;
+        text++;
+    }
+    return lines;
+}
+
+int main(int argc, char* argv[]) {
+    Phase phases[PHASE_COUNT] = {
+            {"macro expansion", 0, 0, 0},
+            {"first pass", 0, 0, 0},
+            {"encoding", 0, 0, 0},
+            {"second pass", 0, 0, 0},
+            {"output", 0, 0, 0},
+            {"whole expansion", 0, 0, 0}
+    };
+    AssemblerContext* context;
+    SourceFile corpus, module;
+    FILE* sink;
+    size_t start, end, expanded, length;
+    long modules = 0, failed = 0;
+    double begin;
+    int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <corpus file>\n", argv[0]);
+        return 1;
+    }
+    if (!source_open(&corpus, argv[1])) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    sink = fopen("/dev/null", "wb");
+    context = malloc(sizeof(AssemblerContext));
+    if (sink == NULL || context == NULL) return 1;
+    init_context(context, argv[1]);
+
+    for (start = 0; start < corpus.size; start = end) {
+        end = next_module(corpus.data, corpus.size, start);
+        reset_context(context);
+        source_from_buffer(&module, corpus.data + start, end - start);
+        modules++;
+
+        begin = now();
+        expand_macros(&context->macros, &context->diagnostics, &module, &context->program, 1);
+        phases[PHASE_EXPANSION].seconds += now() - begin;
+        phases[PHASE_EXPANSION].lines += (double)count_lines(module.data, module.size);
+        phases[PHASE_EXPANSION].bytes += (double)module.size;
+
+        expanded = 0;
+        for (i = 0; i < context->program.count; i++) expanded += context->program.spans[i].length;
+
+        begin = now();
+        perform_first_pass(context, &context->program);
+        phases[PHASE_FIRST_PASS].seconds += now() - begin;
+        for (i = 0; i < context->program.count; i++) {
+            phases[PHASE_FIRST_PASS].lines +=
+                    (double)count_lines(context->program.spans[i].text, context->program.spans[i].length);
+        }
+        phases[PHASE_FIRST_PASS].bytes += (double)expanded;
+
+        begin = now();
+        encode_program(context);
+        phases[PHASE_ENCODING].seconds += now() - begin;
+        phases[PHASE_ENCODING].lines += (double)context->instructions.count;
+        phases[PHASE_ENCODING].bytes += (double)(context->IC - 100) * sizeof(MachineWord);
+
+        begin = now();
+        if (!place_data(&context->image)) return 1;
+        perform_second_pass(context);
+        phases[PHASE_SECOND_PASS].seconds += now() - begin;
+        phases[PHASE_SECOND_PASS].lines += (double)context->fixups.count;
+        phases[PHASE_SECOND_PASS].bytes += (double)(context->IC - 100) * sizeof(MachineWord);
+
+        if (context->diagnostics.error_count > 0) failed++;
+
+        /* The same buffer sizing as write_object_files, without the files */
+        begin = now();
+        length = object_file_size(context);
+        if (references_size(&context->entries) > length) length = references_size(&context->entries);
+        if (references_size(&context->externals) > length) length = references_size(&context->externals);
+        if (length > context->output_capacity) {
+            context->output = realloc(context->output, length);
+            context->output_capacity = length;
+        }
+        length = format_object_file(context, context->output);
+        fwrite(context->output, 1, length, sink);
+        phases[PHASE_OUTPUT].bytes += (double)length;
+        length = format_references(&context->entries, context->output);
+        fwrite(context->output, 1, length, sink);
+        phases[PHASE_OUTPUT].bytes += (double)length;
+        length = format_references(&context->externals, context->output);
+        fwrite(context->output, 1, length, sink);
+        phases[PHASE_OUTPUT].bytes += (double)length;
+        phases[PHASE_OUTPUT].seconds += now() - begin;
+        phases[PHASE_OUTPUT].lines += (double)(context->IC - 100 + context->DC + context->entries.count +
+                                               context->externals.count);
+    }
+
+    reset_context(context);
+    begin = now();
+    expand_macros(&context->macros, &context->diagnostics, &corpus, &context->program, 1);
+    phases[PHASE_WHOLE_EXPANSION].seconds = now() - begin;
+    phases[PHASE_WHOLE_EXPANSION].lines = (double)count_lines(corpus.data, corpus.size);
+    phases[PHASE_WHOLE_EXPANSION].bytes = (double)corpus.size;
+
+    printf("%s: %.0f lines, %.1f MB, %ld modules, %ld with errors\n", argv[1],
+           phases[PHASE_EXPANSION].lines, (double)corpus.size / 1e6, modules, failed);
+    printf("%-16s %10s %14s %10s %12s\n", "phase", "ms", "items/sec", "MB/sec", "items");
+    for (i = 0; i < PHASE_COUNT; i++) {
+        printf("%-16s %10.2f %14.0f %10.1f %12.0f\n", phases[i].name, phases[i].seconds * 1e3,
+               phases[i].seconds > 0 ? phases[i].lines / phases[i].seconds : 0,
+               phases[i].seconds > 0 ? phases[i].bytes / phases[i].seconds / 1e6 : 0, phases[i].lines);
+    }
+    printf("items: source lines, expanded lines, instructions, fixups, output lines and source lines\n");
+
+    free_context(context);
+    free(context);
+    fclose(sink);
+    source_close(&corpus);
+    return 0;
+}
@@ -0,0 +1,92 @@
+/* Compares the implementations of the byte class scanner: the raw speed of
+ * classifying blocks, and lex_line on every line of a source.
+ * Usage: scan_bench <source file> [rounds] */
+
+#include "../scanner.h"
+#include "../lexer.h"
+#include "../source_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char* const level_names[] = {"scalar", "sse2", "avx2"};
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[]) {
+    SourceFile source, reader;
+    LineView* lines;
+    LineView line;
+    ScanMasks masks;
+    Statement statement;
+    size_t line_count = 0, capacity = 1024, offset;
+    unsigned long checksum;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    int level, round;
+    size_t i;
+    double start, blocks_time, lex_time;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <source file> [rounds]\n", argv[0]);
+        return 1;
+    }
+    if (!source_open(&source, argv[1])) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    /* Split the lines once, only the scanner is timed */
+    lines = malloc(capacity * sizeof(LineView));
+    reader = source;
+    while (lines != NULL && source_next_line(&reader, &line)) {
+        if (line_count == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(LineView));
+            if (lines == NULL) break;
+        }
+        lines[line_count++] = line;
+    }
+    if (lines == NULL) return 1;
+
+    printf("%s: %lu lines, %.1f MB, %d rounds\n", argv[1], (unsigned long)line_count,
+           (double)source.size / 1e6, rounds);
+    printf("%-8s %14s %16s %12s\n", "level", "blocks MB/sec", "lex lines/sec", "checksum");
+
+    scan_init();
+    for (level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+        if (!scan_set_level((ScanLevel)level)) {
+            printf("%-8s %14s\n", level_names[level], "unsupported");
+            continue;
+        }
+
+        checksum = 0;
+        start = now();
+        for (round = 0; round < rounds; round++) {
+            for (offset = 0; offset < source.size; offset += SCAN_BLOCK_SIZE) {
+                scan_block(source.data + offset, source.size - offset, &masks);
+                checksum += masks.space ^ masks.alnum ^ masks.comma;
+            }
+        }
+        blocks_time = now() - start;
+
+        start = now();
+        for (round = 0; round < rounds; round++) {
+            for (i = 0; i < line_count; i++) {
+                lex_line(lines[i].text, lines[i].length, &statement);
+                checksum += (unsigned long)statement.kind + (unsigned long)statement.operand_count;
+            }
+        }
+        lex_time = now() - start;
+
+        printf("%-8s %14.1f %16.0f %12lu\n", level_names[level],
+               (double)source.size * rounds / blocks_time / 1e6, (double)line_count * rounds / lex_time, checksum);
+    }
+
+    free(lines);
+    source_close(&source);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* Measures symbol lookup time as the number of symbols grows.
+ * With the hashed index the time per lookup should stay flat. */
+
+#include "../symbol_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUP_ROUNDS 2000000L
+
+static void make_name(char* name, long i) {
+    sprintf(name, "LABEL%ld", i);
+}
+
+int main(void) {
+    static const long sizes[] = {100, 1000, 10000, 100000, 1000000};
+    SymbolTable table;
+    char name[MAX_SYMBOL_LENGTH + 1];
+    unsigned long seed = 12345;
+    long checksum = 0;
+    long i;
+    int s;
+    clock_t start;
+    double insert_ns, lookup_ns;
+
+    init_symbol_table(&table);
+    printf("%10s %14s %14s\n", "symbols", "insert ns/op", "lookup ns/op");
+
+    for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        long count = sizes[s];
+
+        start = clock();
+        for (i = 0; i < count; i++) {
+            make_name(name, i);
+            add_symbol(&table, name, (int)(100 + i), 0);
+        }
+        insert_ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / count;
+
+        /* Pre-format the names outside the timed loop so only lookups are measured */
+        {
+            char (*names)[MAX_SYMBOL_LENGTH + 1] = malloc(4096 * sizeof(*names));
+            if (names == NULL) return 1;
+            for (i = 0; i < 4096; i++) {
+                seed = seed * 1103515245UL + 12345UL;
+                make_name(names[i], (long)((seed >> 8) % (unsigned long)count));
+            }
+
+            start = clock();
+            for (i = 0; i < LOOKUP_ROUNDS; i++) {
+                checksum += lookup_symbol(&table, names[i & 4095]);
+            }
+            lookup_ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / LOOKUP_ROUNDS;
+            free(names);
+        }
+
+        printf("%10ld %14.1f %14.1f\n", count, insert_ns, lookup_ns);
+        free_symbol_table(&table);
+    }
+
+    /* Keep the lookups from being optimised away */
+    fprintf(stderr, "checksum %ld\n", checksum);
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include "cache.h"
+#include "object_writer.h"
+#include "source_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* An entry starts with this line, then a line with the source size and the
+ * sizes of the .am, .ob, .ent and .ext sections that follow it */
+#define CACHE_MAGIC "ASMCACHE " ASSEMBLER_VERSION "\n"
+#define CACHE_SECTIONS 4
+#define CACHE_HEADER_LENGTH (sizeof(CACHE_MAGIC) + 5 * 21)
+#define CACHE_NAME_LENGTH 48
+
+static const char* const section_extensions[CACHE_SECTIONS] = {".am", ".ob", ".ent", ".ext"};
+
+static char* entry_name(const char* directory, const CacheKey* key, const char* suffix);
+static int parse_size(const char** position, const char* end, unsigned long* value);
+static size_t expanded_size(const ExpandedSource* program);
+static char* put_expanded_source(char* out, const ExpandedSource* program);
+
+void cache_key(CacheKey* key, const char* data, size_t size) {
+    const char* version = ASSEMBLER_VERSION;
+    unsigned int fnv = 2166136261u;
+    unsigned int jenkins = 0;
+    size_t i;
+
+    /* The version is hashed first, so a new assembler never reuses old output */
+    for (i = 0; version[i] != '\0'; i++) {
+        fnv = (fnv ^ (unsigned char)version[i]) * 16777619u;
+        jenkins += (unsigned char)version[i];
+        jenkins += jenkins << 10;
+        jenkins ^= jenkins >> 6;
+    }
+
+    /* FNV-1a and Jenkins one-at-a-time over the same bytes in one loop */
+    for (i = 0; i < size; i++) {
+        fnv = (fnv ^ (unsigned char)data[i]) * 16777619u;
+        jenkins += (unsigned char)data[i];
+        jenkins += jenkins << 10;
+        jenkins ^= jenkins >> 6;
+    }
+    jenkins += jenkins << 3;
+    jenkins ^= jenkins >> 11;
+    jenkins += jenkins << 15;
+
+    key->hash[0] = fnv & 0xFFFFFFFFu;
+    key->hash[1] = jenkins & 0xFFFFFFFFu;
+    key->size = (unsigned long)size;
+}
+
+int cache_prepare(const char* directory) {
+#ifdef _WIN32
+    (void)directory;
+    return 0;
+#else
+    struct stat info;
+
+    if (mkdir(directory, 0777) == 0 || errno == EEXIST) {
+        return stat(directory, &info) == 0 && S_ISDIR(info.st_mode);
+    }
+    return 0;
+#endif
+}
+
+/* directory/<hashes>-<size>.asc followed by suffix, in a new buffer */
+static char* entry_name(const char* directory, const CacheKey* key, const char* suffix) {
+    size_t length = strlen(directory) + strlen(suffix) + CACHE_NAME_LENGTH;
+    char* name = malloc(length);
+
+    if (name == NULL) return NULL;
+    sprintf(name, "%s/%08x%08x-%lu.asc%s", directory, key->hash[0], key->hash[1], key->size, suffix);
+    return name;
+}
+
+/* Read a decimal number followed by one separator character */
+static int parse_size(const char** position, const char* end, unsigned long* value) {
+    const char* p = *position;
+
+    *value = 0;
+    if (p == end || *p < '0' || *p > '9') return 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        *value = *value * 10 + (unsigned long)(*p - '0');
+        p++;
+    }
+    if (p == end || (*p != ' ' && *p != '\n')) return 0;
+    *position = p + 1;
+    return 1;
+}
+
+int cache_restore(const char* directory, const CacheKey* key, const char* base, size_t base_length) {
+    SourceFile entry;
+    unsigned long sizes[CACHE_SECTIONS + 1];
+    unsigned long total = 0;
+    const char* position;
+    const char* end;
+    char* entry_path = entry_name(directory, key, "");
+    char* name;
+    int ok = 0;
+    int i;
+
+    if (entry_path == NULL) return 0;
+    if (!source_open(&entry, entry_path)) {
+        free(entry_path);
+        return 0;
+    }
+    free(entry_path);
+
+    /* Check the whole header before writing anything */
+    position = entry.data;
+    end = entry.data + entry.size;
+    if (entry.size < sizeof(CACHE_MAGIC) - 1 ||
+        memcmp(entry.data, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1) != 0) {
+        source_close(&entry);
+        return 0;
+    }
+    position += sizeof(CACHE_MAGIC) - 1;
+    for (i = 0; i <= CACHE_SECTIONS; i++) {
+        if (!parse_size(&position, end, &sizes[i])) {
+            source_close(&entry);
+            return 0;
+        }
+        if (i > 0) total += sizes[i];
+    }
+    if (sizes[0] != key->size || total != (unsigned long)(end - position)) {
+        source_close(&entry);
+        return 0;
+    }
+
+    name = malloc(base_length + 5);
+    if (name != NULL) {
+        memcpy(name, base, base_length);
+        ok = 1;
+        for (i = 0; i < CACHE_SECTIONS; i++) {
+            strcpy(name + base_length, section_extensions[i]);
+            /* Like a real run, empty .ent and .ext files are not created */
+            if (sizes[i + 1] == 0 && i >= 2) {
+                remove(name);
+            } else if (!write_output_file(name, position, sizes[i + 1])) {
+                ok = 0;
+            }
+            position += sizes[i + 1];
+        }
+        free(name);
+    }
+
+    source_close(&entry);
+    return ok;
+}
+
+/* Size of the expanded source as write_expanded_source writes it */
+static size_t expanded_size(const ExpandedSource* program) {
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < program->count; i++) {
+        size += program->spans[i].length;
+        if (program->spans[i].text[program->spans[i].length - 1] != '\n') size++;
+    }
+    return size;
+}
+
+static char* put_expanded_source(char* out, const ExpandedSource* program) {
+    const SourceSpan* span;
+    int i;
+
+    for (i = 0; i < program->count; i++) {
+        span = &program->spans[i];
+        memcpy(out, span->text, span->length);
+        out += span->length;
+        if (span->text[span->length - 1] != '\n') *out++ = '\n';
+    }
+    return out;
+}
+
+int cache_store(const char* directory, const CacheKey* key, const AssemblerContext* context) {
+#ifdef _WIN32
+    (void)directory;
+    (void)key;
+    (void)context;
+    return 0;
+#else
+    unsigned long sizes[CACHE_SECTIONS];
+    size_t capacity;
+    char* buffer;
+    char* out;
+    char* sections;
+    char* entry_path;
+    char* temporary;
+    int fd;
+    int ok;
+
+    capacity = CACHE_HEADER_LENGTH + expanded_size(&context->program) + object_file_size(context) +
+               references_size(&context->entries) + references_size(&context->externals);
+    buffer = malloc(capacity);
+    if (buffer == NULL) return 0;
+
+    /* Format the sections after room for the header, then write the header
+     * in front of them once their sizes are known */
+    sections = buffer + CACHE_HEADER_LENGTH;
+    out = put_expanded_source(sections, &context->program);
+    sizes[0] = (unsigned long)(out - sections);
+    sizes[1] = (unsigned long)format_object_file(context, out);
+    out += sizes[1];
+    sizes[2] = (unsigned long)format_references(&context->entries, out);
+    out += sizes[2];
+    sizes[3] = (unsigned long)format_references(&context->externals, out);
+    out += sizes[3];
+
+    {
+        char header[CACHE_HEADER_LENGTH];
+        size_t header_length = (size_t)sprintf(header, "%s%lu %lu %lu %lu %lu\n", CACHE_MAGIC,
+                                               key->size, sizes[0], sizes[1], sizes[2], sizes[3]);
+        sections -= header_length;
+        memcpy(sections, header, header_length);
+    }
+
+    entry_path = entry_name(directory, key, "");
+    temporary = entry_name(directory, key, ".XXXXXX");
+    ok = entry_path != NULL && temporary != NULL;
+
+    /* Write a private temporary file, then rename it over the entry name.
+     * The rename is atomic, so concurrent builds sharing the directory see
+     * either no entry or a complete one */
+    if (ok) {
+        fd = mkstemp(temporary);
+        ok = fd >= 0;
+        if (ok) {
+            size_t length = (size_t)(out - sections);
+            const char* p = sections;
+            ssize_t written;
+
+            while (ok && length > 0) {
+                written = write(fd, p, length);
+                if (written < 0 && errno == EINTR) continue;
+                ok = written > 0;
+                if (ok) {
+                    p += written;
+                    length -= (size_t)written;
+                }
+            }
+            fchmod(fd, 0644);
+            if (close(fd) != 0) ok = 0;
+            if (ok) ok = rename(temporary, entry_path) == 0;
+            if (!ok) remove(temporary);
+        }
+    }
+
+    free(entry_path);
+    free(temporary);
+    free(buffer);
+    return ok;
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include "assembler.h"
+
+/* Identifies the result of assembling some source bytes with this version
+ * of the assembler. Two independent 32-bit hashes and the size together
+ * make up the name of the cache entry */
+typedef struct {
+    unsigned int hash[2];
+    unsigned long size;
+} CacheKey;
+
+/* Compute the key of a source */
+void cache_key(CacheKey* key, const char* data, size_t size);
+
+/* Create the cache directory if it does not exist yet. Returns 0 if it
+ * cannot be created */
+int cache_prepare(const char* directory);
+
+/* Restore base.am, base.ob, base.ent and base.ext from the cache entry of
+ * key. Returns 0 on a miss or a damaged entry, nothing is written then */
+int cache_restore(const char* directory, const CacheKey* key, const char* base, size_t base_length);
+
+/* Store the output of a context that assembled without errors. The entry is
+ * written under a temporary name and renamed into place, so readers never
+ * see a partial entry. Returns 0 if the entry could not be written */
+int cache_store(const char* directory, const CacheKey* key, const AssemblerContext* context);
+
+#endif /* CACHE_H */
@@ -0,0 +1,343 @@
+#include "diagnostics.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int reserve(Diagnostics* diagnostics, size_t extra);
+static int reserve_arguments(Diagnostics* diagnostics, size_t extra);
+static size_t packed_size(const char* format, va_list args);
+static void pack_arguments(char* out, const char* format, va_list args);
+static int sort_key(int line_number);
+static int compare_items(const void* a, const void* b);
+static int format_item(Diagnostics* diagnostics, const Diagnostic* item);
+
+/* Make room for extra more characters, growing the buffer geometrically */
+static int reserve(Diagnostics* diagnostics, size_t extra) {
+    size_t capacity = diagnostics->capacity ? diagnostics->capacity : 1024;
+    char* grown;
+
+    if (diagnostics->length + extra <= diagnostics->capacity) return 1;
+
+    while (capacity < diagnostics->length + extra) capacity *= 2;
+    grown = realloc(diagnostics->text, capacity);
+    if (grown == NULL) return 0;
+
+    diagnostics->text = grown;
+    diagnostics->capacity = capacity;
+    return 1;
+}
+
+/* Same as reserve, for the argument buffer */
+static int reserve_arguments(Diagnostics* diagnostics, size_t extra) {
+    size_t capacity = diagnostics->arguments_capacity ? diagnostics->arguments_capacity : 1024;
+    char* grown;
+
+    if (diagnostics->arguments_length + extra <= diagnostics->arguments_capacity) return 1;
+
+    while (capacity < diagnostics->arguments_length + extra) capacity *= 2;
+    grown = realloc(diagnostics->arguments, capacity);
+    if (grown == NULL) return 0;
+
+    diagnostics->arguments = grown;
+    diagnostics->arguments_capacity = capacity;
+    return 1;
+}
+
+/* Bytes the arguments of a format take once packed. A number is packed
+ * as an int, a string as its length followed by its characters */
+static size_t packed_size(const char* format, va_list args) {
+    size_t size = 0;
+    const char* text;
+    int length;
+
+    for (; *format != '\0'; format++) {
+        if (*format != '%') continue;
+        format++;
+        if (*format == 'd' || *format == 'c') {
+            (void)va_arg(args, int);
+            size += sizeof(int);
+        } else if (*format == 's') {
+            text = va_arg(args, const char*);
+            size += sizeof(int) + strlen(text);
+        } else if (strncmp(format, ".*s", 3) == 0) {
+            length = va_arg(args, int);
+            (void)va_arg(args, const char*);
+            size += sizeof(int) + (size_t)length;
+            format += 2;
+        } else if (*format == '\0') {
+            break;
+        }
+    }
+    return size;
+}
+
+/* Pack the arguments of a format, see packed_size */
+static void pack_arguments(char* out, const char* format, va_list args) {
+    const char* text;
+    int value;
+
+    for (; *format != '\0'; format++) {
+        if (*format != '%') continue;
+        format++;
+        if (*format == 'd' || *format == 'c') {
+            value = va_arg(args, int);
+            memcpy(out, &value, sizeof(int));
+            out += sizeof(int);
+            continue;
+        }
+        if (*format == 's') {
+            text = va_arg(args, const char*);
+            value = (int)strlen(text);
+        } else if (strncmp(format, ".*s", 3) == 0) {
+            value = va_arg(args, int);
+            text = va_arg(args, const char*);
+            format += 2;
+        } else if (*format == '\0') {
+            break;
+        } else {
+            continue;
+        }
+        memcpy(out, &value, sizeof(int));
+        if (value > 0) memcpy(out + sizeof(int), text, (size_t)value);
+        out += sizeof(int) + (size_t)value;
+    }
+}
+
+/* Messages without a line come after all the others */
+static int sort_key(int line_number) {
+    return line_number > 0 ? line_number : INT_MAX;
+}
+
+static int compare_items(const void* a, const void* b) {
+    const Diagnostic* first = a;
+    const Diagnostic* second = b;
+    int first_key = sort_key(first->line_number);
+    int second_key = sort_key(second->line_number);
+
+    if (first_key != second_key) return first_key < second_key ? -1 : 1;
+    return first->sequence < second->sequence ? -1 : (first->sequence > second->sequence);
+}
+
+void init_diagnostics(Diagnostics* diagnostics, const char* filename) {
+    diagnostics->filename = filename;
+    diagnostics->items = NULL;
+    diagnostics->count = 0;
+    diagnostics->item_capacity = 0;
+    diagnostics->arguments = NULL;
+    diagnostics->arguments_length = 0;
+    diagnostics->arguments_capacity = 0;
+    diagnostics->text = NULL;
+    diagnostics->length = 0;
+    diagnostics->capacity = 0;
+    diagnostics->formatted = 1;
+    diagnostics->last_line = 0;
+    diagnostics->dropped = 0;
+    diagnostics->error_count = 0;
+    diagnostics->max_errors = 0;
+    pthread_mutex_init(&diagnostics->lock, NULL);
+}
+
+void report_error(Diagnostics* diagnostics, int line_number, const char* format, ...) {
+    va_list args;
+    Diagnostic* item;
+    Diagnostic* grown;
+    size_t size;
+    int capacity;
+
+    /* Measured before taking the lock, packing is only a copy */
+    va_start(args, format);
+    size = packed_size(format, args);
+    va_end(args);
+
+    pthread_mutex_lock(&diagnostics->lock);
+    diagnostics->error_count++;
+
+    /* Once max_errors messages are kept, one that sorts after all of them
+     * would never be shown. Errors are mostly reported in line order, so
+     * most of a flood of errors is only counted */
+    if (diagnostics->max_errors > 0 && diagnostics->count >= diagnostics->max_errors &&
+        sort_key(line_number) >= diagnostics->last_line) {
+        diagnostics->dropped++;
+        diagnostics->formatted = 0;
+        pthread_mutex_unlock(&diagnostics->lock);
+        return;
+    }
+
+    if (diagnostics->count == diagnostics->item_capacity) {
+        capacity = diagnostics->item_capacity ? diagnostics->item_capacity * 2 : 64;
+        grown = realloc(diagnostics->items, (size_t)capacity * sizeof(Diagnostic));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&diagnostics->lock);
+            return;
+        }
+        diagnostics->items = grown;
+        diagnostics->item_capacity = capacity;
+    }
+    if (!reserve_arguments(diagnostics, size)) {
+        pthread_mutex_unlock(&diagnostics->lock);
+        return;
+    }
+
+    item = &diagnostics->items[diagnostics->count];
+    item->line_number = line_number;
+    item->sequence = diagnostics->count;
+    item->format = format;
+    item->arguments = diagnostics->arguments_length;
+
+    va_start(args, format);
+    pack_arguments(diagnostics->arguments + diagnostics->arguments_length, format, args);
+    va_end(args);
+
+    diagnostics->arguments_length += size;
+    diagnostics->count++;
+    diagnostics->formatted = 0;
+    if (sort_key(line_number) > diagnostics->last_line) diagnostics->last_line = sort_key(line_number);
+    pthread_mutex_unlock(&diagnostics->lock);
+}
+
+/* Append one message as file:line: error: message */
+static int format_item(Diagnostics* diagnostics, const Diagnostic* item) {
+    const char* format = item->format;
+    const char* packed = diagnostics->arguments + item->arguments;
+    size_t filename_length = strlen(diagnostics->filename);
+    int value;
+
+    /* The prefix, with room for the line number */
+    if (!reserve(diagnostics, filename_length + 32)) return 0;
+    memcpy(diagnostics->text + diagnostics->length, diagnostics->filename, filename_length);
+    diagnostics->length += filename_length;
+    if (item->line_number > 0) {
+        diagnostics->length += (size_t)sprintf(diagnostics->text + diagnostics->length, ":%d", item->line_number);
+    }
+    memcpy(diagnostics->text + diagnostics->length, ": error: ", 9);
+    diagnostics->length += 9;
+
+    for (; *format != '\0'; format++) {
+        if (!reserve(diagnostics, 16)) return 0;
+        if (*format != '%' || format[1] == '\0') {
+            diagnostics->text[diagnostics->length++] = *format;
+            continue;
+        }
+
+        format++;
+        if (*format == 'd') {
+            memcpy(&value, packed, sizeof(int));
+            packed += sizeof(int);
+            diagnostics->length += (size_t)sprintf(diagnostics->text + diagnostics->length, "%d", value);
+        } else if (*format == 'c') {
+            memcpy(&value, packed, sizeof(int));
+            packed += sizeof(int);
+            diagnostics->text[diagnostics->length++] = (char)value;
+        } else if (*format == 's' || strncmp(format, ".*s", 3) == 0) {
+            if (*format != 's') format += 2;
+            memcpy(&value, packed, sizeof(int));
+            packed += sizeof(int);
+            if (value <= 0) continue;
+            if (!reserve(diagnostics, (size_t)value)) return 0;
+            memcpy(diagnostics->text + diagnostics->length, packed, (size_t)value);
+            diagnostics->length += (size_t)value;
+            packed += value;
+        } else {
+            diagnostics->text[diagnostics->length++] = *format;
+        }
+    }
+
+    if (!reserve(diagnostics, 1)) return 0;
+    diagnostics->text[diagnostics->length++] = '\n';
+    return 1;
+}
+
+int format_diagnostics(Diagnostics* diagnostics) {
+    int shown = diagnostics->count;
+    int i;
+
+    if (diagnostics->formatted) return 1;
+    diagnostics->length = 0;
+
+    if (diagnostics->count > 1) {
+        qsort(diagnostics->items, (size_t)diagnostics->count, sizeof(Diagnostic), compare_items);
+    }
+    if (diagnostics->max_errors > 0 && shown > diagnostics->max_errors) shown = diagnostics->max_errors;
+    for (i = 0; i < shown; i++) {
+        if (!format_item(diagnostics, &diagnostics->items[i])) return 0;
+    }
+
+    if (shown < diagnostics->count || diagnostics->dropped > 0) {
+        if (!reserve(diagnostics, strlen(diagnostics->filename) + 64)) return 0;
+        diagnostics->length += (size_t)sprintf(diagnostics->text + diagnostics->length,
+                                               "%s: note: %d more errors not shown\n", diagnostics->filename,
+                                               diagnostics->count - shown + diagnostics->dropped);
+    }
+    diagnostics->formatted = 1;
+    return 1;
+}
+
+void flush_diagnostics(Diagnostics* diagnostics, FILE* stream) {
+    if (!format_diagnostics(diagnostics)) {
+        fprintf(stream, "%s: error: Out of memory while formatting %d errors\n", diagnostics->filename,
+                diagnostics->error_count);
+    } else if (diagnostics->length > 0) {
+        fwrite(diagnostics->text, 1, diagnostics->length, stream);
+    }
+    diagnostics->count = 0;
+    diagnostics->arguments_length = 0;
+    diagnostics->length = 0;
+    diagnostics->formatted = 1;
+    diagnostics->last_line = 0;
+    diagnostics->dropped = 0;
+}
+
+void clear_diagnostics(Diagnostics* diagnostics) {
+    diagnostics->count = 0;
+    diagnostics->arguments_length = 0;
+    diagnostics->length = 0;
+    diagnostics->formatted = 1;
+    diagnostics->last_line = 0;
+    diagnostics->dropped = 0;
+    diagnostics->error_count = 0;
+}
+
+void move_diagnostics(Diagnostics* to, Diagnostics* from) {
+    Diagnostics kept = *to;
+
+    /* The buffers change hands, each keeps its own lock and settings */
+    to->items = from->items;
+    to->count = from->count;
+    to->item_capacity = from->item_capacity;
+    to->arguments = from->arguments;
+    to->arguments_length = from->arguments_length;
+    to->arguments_capacity = from->arguments_capacity;
+    to->text = from->text;
+    to->length = from->length;
+    to->capacity = from->capacity;
+    to->formatted = 0;
+    to->last_line = from->last_line;
+    to->dropped = from->dropped;
+    to->error_count = from->error_count;
+
+    from->items = kept.items;
+    from->item_capacity = kept.item_capacity;
+    from->arguments = kept.arguments;
+    from->arguments_capacity = kept.arguments_capacity;
+    from->text = kept.text;
+    from->capacity = kept.capacity;
+    clear_diagnostics(from);
+}
+
+void free_diagnostics(Diagnostics* diagnostics) {
+    free(diagnostics->items);
+    free(diagnostics->arguments);
+    free(diagnostics->text);
+    diagnostics->items = NULL;
+    diagnostics->count = 0;
+    diagnostics->item_capacity = 0;
+    diagnostics->arguments = NULL;
+    diagnostics->arguments_length = 0;
+    diagnostics->arguments_capacity = 0;
+    diagnostics->text = NULL;
+    diagnostics->length = 0;
+    diagnostics->capacity = 0;
+    diagnostics->formatted = 1;
+    pthread_mutex_destroy(&diagnostics->lock);
+}
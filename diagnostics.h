@@ -0,0 +1,63 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stddef.h>
+
+/* One recorded message. The format is a string literal, its arguments
+ * are packed in the argument buffer until the message is formatted */
+typedef struct {
+    int line_number;          /* 0 when the message is not tied to a line */
+    int sequence;             /* Order of reporting, for messages of the same line */
+    const char* format;
+    size_t arguments;         /* Offset of the packed arguments */
+} Diagnostic;
+
+/* Messages reported while assembling one file.
+ * They are collected in memory so that files assembled at the same time
+ * can print their messages one file after another, and are only formatted
+ * when the text is needed, sorted by line */
+typedef struct {
+    const char* filename;
+    Diagnostic* items;
+    int count;
+    int item_capacity;
+    char* arguments;          /* Packed arguments of all items */
+    size_t arguments_length;
+    size_t arguments_capacity;
+    char* text;               /* Formatted messages, see format_diagnostics */
+    size_t length;
+    size_t capacity;
+    int formatted;            /* Whether text is up to date with the items */
+    int last_line;            /* Sort key of the last item in line order */
+    int dropped;              /* Messages past max_errors that were only counted */
+    int error_count;
+    int max_errors;           /* Most messages to format, 0 for all of them */
+    pthread_mutex_t lock;     /* Lets several threads report at the same time */
+} Diagnostics;
+
+void init_diagnostics(Diagnostics* diagnostics, const char* filename);
+
+/* Record an error, line_number 0 means the error is not tied to a line.
+ * Only %d, %c, %s, %.*s and %% may be used in the format, which must stay
+ * valid until the message is formatted. Safe to call from several threads */
+void report_error(Diagnostics* diagnostics, int line_number, const char* format, ...);
+
+/* Format the recorded messages into text and length: sorted by line, those
+ * without a line last, and no more than max_errors of them.
+ * Returns 0 if out of memory */
+int format_diagnostics(Diagnostics* diagnostics);
+
+/* Write all recorded messages to a stream and clear them */
+void flush_diagnostics(Diagnostics* diagnostics, FILE* stream);
+
+/* Drop all recorded messages but keep the buffers */
+void clear_diagnostics(Diagnostics* diagnostics);
+
+/* Hand the messages of from over to to, leaving from empty */
+void move_diagnostics(Diagnostics* to, Diagnostics* from);
+
+void free_diagnostics(Diagnostics* diagnostics);
+
+#endif /* DIAGNOSTICS_H */
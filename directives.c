@@ -0,0 +1,144 @@
+#include "directives.h"
+#include "keywords.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Bytes set in every byte of a word */
+#define BYTES(byte) ((uint32_t)0x01010101UL * (byte))
+
+static uint32_t load_four(const char* text, const char* end);
+static int leading_digits(uint32_t chunk);
+static uint32_t four_digit_value(uint32_t chunk, int digits);
+static const char* parse_number(const char* text, const char* end, long* value);
+
+/* Read the four bytes at text, with the first one in the low byte.
+ * Bytes at or past end read as zero */
+static uint32_t load_four(const char* text, const char* end) {
+    uint32_t chunk = 0;
+    int i;
+
+    for (i = 0; i < 4 && text + i < end; i++) {
+        chunk |= (uint32_t)(unsigned char)text[i] << (8 * i);
+    }
+    return chunk;
+}
+
+/* Number of ASCII digits at the start of a chunk. A byte is a digit if its
+ * high nibble is 3 and adding 6 to its low nibble does not carry; neither
+ * test carries into the next byte */
+static int leading_digits(uint32_t chunk) {
+    uint32_t other = ((chunk & BYTES(0xF0)) ^ BYTES(0x30)) | (((chunk & BYTES(0x0F)) + BYTES(0x06)) & BYTES(0xF0));
+    int digits = 0;
+
+    /* Set the high bit of every byte that is not a digit */
+    other = (other | ((other & BYTES(0x7F)) + BYTES(0x7F))) & BYTES(0x80);
+    if (other == 0) return 4;
+    while ((other & 0x80) == 0) {
+        other >>= 8;
+        digits++;
+    }
+    return digits;
+}
+
+/* Value of the first 1 to 4 digits of a chunk. They are moved to the top
+ * of the word, leaving leading zeros, and then pairs of digits and the
+ * two pairs are combined with one multiply each */
+static uint32_t four_digit_value(uint32_t chunk, int digits) {
+    chunk = (chunk & BYTES(0x0F)) << (8 * (4 - digits));
+    chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FFUL;
+    return (chunk * 100 + (chunk >> 16)) & 0xFFFFUL;
+}
+
+/* Parse an optionally signed decimal number. Values too large for a data
+ * word are kept above DATA_MAX rather than computed exactly.
+ * Returns the end of its digits, or text if there are none */
+static const char* parse_number(const char* text, const char* end, long* value) {
+    const char* p = text;
+    int negative = 0;
+    int digits;
+
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    digits = leading_digits(load_four(p, end));
+    if (digits == 0) return text;
+
+    *value = (long)four_digit_value(load_four(p, end), digits);
+    p += digits;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (*value <= DATA_MAX + 1) *value = *value * 10 + (*p - '0');
+    }
+    if (negative) *value = -*value;
+    return p;
+}
+
+int parse_data(const char* text, size_t length, WordBuffer* data, const char** error) {
+    const char* end = text + length;
+    const char* p = text;
+    const char* item;
+    int count = data->count;
+    long value = 0;
+
+    if (length == 0) return ARGUMENTS_MISSING;
+
+    /* Every number takes a digit and a comma, except for the last one */
+    if (!reserve_words(data, data->count + (int)(length / 2) + 1)) return ARGUMENTS_NO_MEMORY;
+
+    for (;;) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        item = p;
+        p = parse_number(p, end, &value);
+
+        if (p == item) {
+            *error = item;
+            data->count = count;
+            return item == end || *item == ',' ? ARGUMENTS_EMPTY_ITEM : ARGUMENTS_INVALID;
+        }
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p < end && *p != ',') {
+            *error = p;
+            data->count = count;
+            return ARGUMENTS_INVALID;
+        }
+        if (value < DATA_MIN || value > DATA_MAX) {
+            *error = item;
+            data->count = count;
+            return ARGUMENTS_OUT_OF_RANGE;
+        }
+
+        IMAGE_APPEND(data, (MachineWord)(value & 0x7FFF));
+        if (p == end) return ARGUMENTS_VALID;
+        p++; /* Past the comma */
+    }
+}
+
+int parse_string(const char* text, size_t length, WordBuffer* data) {
+    const unsigned char* characters = (const unsigned char*)text + 1;
+    MachineWord* words;
+    size_t count;
+    size_t i;
+
+    if (length == 0) return ARGUMENTS_MISSING;
+    if (length < 2 || text[0] != '"' || text[length - 1] != '"') return ARGUMENTS_INVALID;
+    count = length - 2;
+    if (!resize_words(data, data->count + (int)count + 1)) return ARGUMENTS_NO_MEMORY;
+
+    /* The characters and the zero after them fill the words just added */
+    words = &IMAGE_WORD(data, data->count - (int)count - 1);
+    for (i = 0; i < count; i++) {
+        words[i] = characters[i];
+    }
+    words[count] = 0;
+    return ARGUMENTS_VALID;
+}
+
+int check_symbol_argument(const char* text, size_t length) {
+    size_t i;
+
+    if (length == 0) return ARGUMENTS_MISSING;
+    if (!isalpha((unsigned char)text[0])) return ARGUMENTS_INVALID;
+    for (i = 1; i < length; i++) {
+        if (!isalnum((unsigned char)text[i])) return ARGUMENTS_INVALID;
+    }
+    return find_keyword(text, length) == NULL ? ARGUMENTS_VALID : ARGUMENTS_INVALID;
+}
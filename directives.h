@@ -0,0 +1,33 @@
+#ifndef DIRECTIVES_H
+#define DIRECTIVES_H
+
+#include <stddef.h>
+#include "image.h"
+
+/* Range of a .data value, a two's complement number of WORD_SIZE bits */
+#define DATA_MIN (-(1 << (WORD_SIZE - 1)))
+#define DATA_MAX ((1 << (WORD_SIZE - 1)) - 1)
+
+/* Results of the directive argument parsers */
+#define ARGUMENTS_VALID 0
+#define ARGUMENTS_MISSING 1       /* Nothing follows the directive */
+#define ARGUMENTS_EMPTY_ITEM 2    /* No number before, between or after the commas of a .data list */
+#define ARGUMENTS_INVALID 3       /* Not a number, quoted string or symbol name */
+#define ARGUMENTS_OUT_OF_RANGE 4
+#define ARGUMENTS_NO_MEMORY 5
+
+/* Append the numbers of a .data argument list to data. The list is
+ * converted four digits at a time within a 32-bit word. On an error
+ * nothing is appended and error points at the item in question.
+ * Returns one of the ARGUMENTS_ results */
+int parse_data(const char* text, size_t length, WordBuffer* data, const char** error);
+
+/* Append the characters of a .string argument and a terminating zero to
+ * data. Returns one of the ARGUMENTS_ results */
+int parse_string(const char* text, size_t length, WordBuffer* data);
+
+/* Check the argument of .extern or .entry: a single symbol name.
+ * Returns one of the ARGUMENTS_ results */
+int check_symbol_argument(const char* text, size_t length);
+
+#endif /* DIRECTIVES_H */
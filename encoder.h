@@ -2,6 +2,7 @@
 #define ENCODER_H
 
 #include <stdint.h>
+#include "keywords.h"
 
 #define WORD_SIZE 15
 
@@ -10,9 +11,28 @@
  * This type ensures we have a consistent 16-bit size across different systems */
 typedef unsigned short MachineWord;
 
-/* Function to encode a single instruction
- * This function takes a string representation of an assembly instruction
- * and converts it into its machine code equivalent */
-void encode_instruction(const char* instruction);
+/* A/R/E field in the three low bits of a word */
+#define ARE_ABSOLUTE 4
+#define ARE_RELOCATABLE 2
+#define ARE_EXTERNAL 1
 
-#endif /* ENCODER_H */
\ No newline at end of file
+/* Highest address an operand word holds above its A/R/E field */
+#define ADDRESS_MAX ((1 << (WORD_SIZE - 3)) - 1)
+
+struct AssemblerContext;
+struct FixupList;
+
+/* Function to encode the instructions the first pass collected
+ * This sizes the code segment of the image to the IC, sweeps the
+ * instruction list once and writes the words of every instruction at its
+ * address. Words that need a symbol address are recorded as fixups for
+ * the second pass */
+void encode_program(struct AssemblerContext* context);
+
+/* Encode the instructions from first up to last, recording their fixups
+ * in fixups. The code segment must already hold their words. Different
+ * ranges can be encoded at the same time, each with its own fixup list.
+ * Returns 0 if out of memory */
+int encode_instructions(struct AssemblerContext* context, int first, int last, struct FixupList* fixups);
+
+#endif /* ENCODER_H */
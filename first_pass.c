@@ -1,87 +1,235 @@
 #include "first_pass.h"
 #include "encoder.h"
+#include "ir.h"
 #include "symbol_table.h"
 #include "operand_validation.h"
+#include "lexer.h"
+#include "directives.h"
+#include "keywords.h"
+#include "source_reader.h"
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 
-extern int IC;
-extern int DC;
+static void handle_label(AssemblerContext* context, const LineView* line, const Statement* statement, int address,
+                         int is_data);
+static void handle_instruction(AssemblerContext* context, const LineView* line, const Statement* statement);
+static void handle_directive(AssemblerContext* context, const LineView* line, const Statement* statement);
+static void handle_symbol_directive(AssemblerContext* context, const LineView* line, const Statement* statement);
+static int operand_payload(AssemblerContext* context, const Operand* operand, int* payload);
+static void add_statement(AssemblerContext* context, const LineView* line, const Statement* statement);
 
-static void process_line(char* line);
-static void handle_label(char* line);
-static void handle_instruction(char* line);
-static void handle_directive(char* line);
+void perform_first_pass(AssemblerContext* context, const ExpandedSource* program) {
+    SpanCursor cursor;
+    LineView line;
 
-void perform_first_pass(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    char line[MAX_LINE_LENGTH + 1];
+    context->IC = 100; /* Starting address */
+    context->DC = 0;
 
-    if (file == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        return;
+    span_cursor_init(&cursor, program);
+    while (span_next_line(&cursor, &line)) {
+        first_pass_line(context, &line);
     }
+    relocate_data_symbols(&context->symbols, context->IC);
+}
 
-    IC = 100; /* Starting address */
-    DC = 0;
+void first_pass_line(AssemblerContext* context, const LineView* line) {
+    Statement statement;
+
+    if (line->length > MAX_LINE_LENGTH) {
+        report_error(&context->diagnostics, line->line_number, "Line is longer than %d characters",
+                     MAX_LINE_LENGTH);
+    }
 
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0; /* Remove newline */
-        if (line[0] == ';' || line[0] == '\0') continue; /* Skip comments and empty lines */
-        process_line(line);
+    lex_line(line->text, line->length, &statement);
+    if (statement.kind == STATEMENT_EMPTY) return; /* Skip comments and empty lines */
+
+    /* A label names the next word of code or data. Before .extern and
+     * .entry it has nothing to name and is ignored */
+    if (statement.label_length > 0) {
+        if (statement.kind != STATEMENT_DIRECTIVE) {
+            handle_label(context, line, &statement, context->IC, 0);
+        } else if (statement.keyword->value == DIRECTIVE_DATA || statement.keyword->value == DIRECTIVE_STRING) {
+            handle_label(context, line, &statement, context->DC, 1);
+        }
     }
 
-    fclose(file);
+    if (statement.kind == STATEMENT_DIRECTIVE) {
+        handle_directive(context, line, &statement);
+    } else {
+        handle_instruction(context, line, &statement);
+    }
 }
 
-static void process_line(char* line) {
-    if (is_label(line)) {
-        handle_label(line);
+/* Add the label to the symbol table */
+static void handle_label(AssemblerContext* context, const LineView* line, const Statement* statement, int address,
+                         int is_data) {
+    char label[MAX_SYMBOL_LENGTH + 1];
+    size_t length = statement->label_length;
+
+    /* Symbols keep only their first MAX_SYMBOL_LENGTH characters */
+    if (length > MAX_SYMBOL_LENGTH) length = MAX_SYMBOL_LENGTH;
+    memcpy(label, statement->label, length);
+    label[length] = '\0';
+
+    switch (add_symbol(&context->symbols, label, address, is_data)) {
+        case SYMBOL_DUPLICATE:
+            report_error(&context->diagnostics, line->line_number, "Symbol '%.*s' is already defined",
+                         (int)statement->label_length, statement->label);
+            break;
+        case SYMBOL_NO_MEMORY:
+            report_error(&context->diagnostics, line->line_number, "Out of memory while adding symbol '%.*s'",
+                         (int)statement->label_length, statement->label);
+            break;
     }
+}
 
-    while (isspace(*line)) line++;
+static void handle_instruction(AssemblerContext* context, const LineView* line, const Statement* statement) {
+    const Operand* operand;
 
-    if (strncmp(line, ".data", 5) == 0 || strncmp(line, ".string", 7) == 0 ||
-        strncmp(line, ".extern", 7) == 0 || strncmp(line, ".entry", 6) == 0) {
-        handle_directive(line);
-    } else {
-        handle_instruction(line);
+    if (statement->kind != STATEMENT_INSTRUCTION) {
+        report_error(&context->diagnostics, line->line_number, "Unknown command at column %d: %.*s",
+                     line_column(line, statement->word), (int)line->length, line->text);
+        return;
+    }
+
+    switch (check_operands(statement)) {
+        case OPERANDS_WRONG_COUNT:
+            report_error(&context->diagnostics, line->line_number, "Wrong number of operands: %.*s",
+                         (int)line->length, line->text);
+            break;
+        case OPERANDS_INVALID:
+            report_error(&context->diagnostics, line->line_number, "Invalid operands: %.*s",
+                         (int)line->length, line->text);
+            break;
+        case OPERANDS_OUT_OF_RANGE:
+            operand = immediate_in_range(&statement->operands[0]) ? &statement->operands[1] : &statement->operands[0];
+            report_error(&context->diagnostics, line->line_number, "Number out of range at column %d: %.*s",
+                         line_column(line, operand->text), (int)line->length, line->text);
+            break;
+        default:
+            add_statement(context, line, statement);
+            break;
     }
 }
 
-static void handle_label(char* line) {
-    char label[MAX_LINE_LENGTH];
-    char* colon = strchr(line, ':');
+/* Get what the encoder needs of an operand: its value, register number or
+ * the index of the symbol it names. Returns 0 if out of memory */
+static int operand_payload(AssemblerContext* context, const Operand* operand, int* payload) {
+    if (operand->method == ADDR_DIRECT) {
+        *payload = reference_symbol(&context->symbols, operand->text, operand->length);
+        return *payload >= 0;
+    }
+    *payload = operand->value;
+    return 1;
+}
 
-    strncpy(label, line, colon - line);
-    label[colon - line] = '\0';
+/* Add a validated instruction to the instruction list at the current IC and
+ * move the IC past its words. It is encoded after the first pass */
+static void add_statement(AssemblerContext* context, const LineView* line, const Statement* statement) {
+    const Keyword* command = statement->keyword;
+    const Operand* source = &statement->operands[0];
+    const Operand* destination = &statement->operands[1];
+    int source_payload = 0, destination_payload = 0;
+    int modes = 0;
+    int ok = 1;
+
+    /* A single operand is the destination */
+    if (command->operand_count == 1) destination = source;
+
+    if (command->operand_count == 2) {
+        ok = operand_payload(context, source, &source_payload);
+        modes |= IR_HAS_SOURCE | IR_MODES(source->method, 0);
+    }
+    if (command->operand_count >= 1) {
+        ok = operand_payload(context, destination, &destination_payload) && ok;
+        modes |= IR_HAS_DESTINATION | IR_MODES(0, destination->method);
+    }
 
-    add_symbol(label, IC);
+    if (!ok || !add_instruction(&context->instructions, command->value, modes, source_payload, destination_payload,
+                         context->IC, line->line_number)) {
+        report_error(&context->diagnostics, line->line_number, "Out of memory");
+    }
+    context->IC += 1 + command->operand_count;
+}
 
-    line = colon + 1;
-    while (isspace(*line)) line++;
+/* Append the words of .data and .string to the data segment */
+static void handle_directive(AssemblerContext* context, const LineView* line, const Statement* statement) {
+    const char* error = statement->arguments;
+    int result;
+
+    switch (statement->keyword->value) {
+        case DIRECTIVE_DATA:
+            result = parse_data(statement->arguments, statement->arguments_length, &context->image.data, &error);
+            break;
+        case DIRECTIVE_STRING:
+            result = parse_string(statement->arguments, statement->arguments_length, &context->image.data);
+            break;
+        default:
+            handle_symbol_directive(context, line, statement);
+            return;
+    }
+    context->DC = context->image.data.count;
+
+    switch (result) {
+        case ARGUMENTS_MISSING:
+            report_error(&context->diagnostics, line->line_number, "Missing argument: %.*s",
+                         (int)line->length, line->text);
+            break;
+        case ARGUMENTS_EMPTY_ITEM:
+            report_error(&context->diagnostics, line->line_number, "Missing number at column %d: %.*s",
+                         line_column(line, error), (int)line->length, line->text);
+            break;
+        case ARGUMENTS_INVALID:
+            if (statement->keyword->value == DIRECTIVE_STRING) {
+                report_error(&context->diagnostics, line->line_number, "Invalid string, quotes expected: %.*s",
+                             (int)line->length, line->text);
+            } else {
+                report_error(&context->diagnostics, line->line_number, "Invalid number at column %d: %.*s",
+                             line_column(line, error), (int)line->length, line->text);
+            }
+            break;
+        case ARGUMENTS_OUT_OF_RANGE:
+            report_error(&context->diagnostics, line->line_number, "Number out of range at column %d: %.*s",
+                         line_column(line, error), (int)line->length, line->text);
+            break;
+        case ARGUMENTS_NO_MEMORY:
+            report_error(&context->diagnostics, line->line_number, "Out of memory");
+            break;
+    }
 }
 
-static void handle_instruction(char* line) {
-    char first_operand[MAX_LINE_LENGTH], second_operand[MAX_LINE_LENGTH];
-    extract_operands(line, first_operand, second_operand);
+/* Mark the symbol of .extern or .entry in the symbol table */
+static void handle_symbol_directive(AssemblerContext* context, const LineView* line, const Statement* statement) {
+    char name[MAX_SYMBOL_LENGTH + 1];
+    size_t length = statement->arguments_length;
+
+    switch (check_symbol_argument(statement->arguments, length)) {
+        case ARGUMENTS_MISSING:
+            report_error(&context->diagnostics, line->line_number, "Missing symbol name: %.*s",
+                         (int)line->length, line->text);
+            return;
+        case ARGUMENTS_INVALID:
+            report_error(&context->diagnostics, line->line_number, "Invalid symbol name: %.*s",
+                         (int)line->length, line->text);
+            return;
+    }
 
-    if (validate_operand(first_operand, 0) && validate_operand(second_operand, 0)) {
-        encode_instruction(line);
-    } else {
-        fprintf(stderr, "Invalid operands in line: %s\n", line);
+    if (length > MAX_SYMBOL_LENGTH) length = MAX_SYMBOL_LENGTH;
+    memcpy(name, statement->arguments, length);
+    name[length] = '\0';
+
+    if (statement->keyword->value == DIRECTIVE_ENTRY) {
+        if (!mark_entry(&context->symbols, name, line->line_number)) {
+            report_error(&context->diagnostics, line->line_number, "Out of memory");
+        }
+        return;
+    }
+    switch (mark_external(&context->symbols, name)) {
+        case SYMBOL_DUPLICATE:
+            report_error(&context->diagnostics, line->line_number, "Symbol '%s' is already defined", name);
+            break;
+        case SYMBOL_NO_MEMORY:
+            report_error(&context->diagnostics, line->line_number, "Out of memory");
+            break;
     }
 }
-
-static void handle_directive(char* line) {
-    if (strncmp(line, ".data", 5) == 0) {
-        /* Handle .data directive */
-    } else if (strncmp(line, ".string", 7) == 0) {
-        /* Handle .string directive */
-    } else if (strncmp(line, ".extern", 7) == 0) {
-        /* Handle .extern directive */
-    } else if (strncmp(line, ".entry", 6) == 0) {
-        /* Handle .entry directive */
-    }
-}
\ No newline at end of file
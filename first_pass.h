@@ -1,9 +1,17 @@
 #ifndef FIRST_PASS_H
 #define FIRST_PASS_H
 
+#include "assembler.h"
+#include "macros.h"
+
+/* Longest line the language allows, not counting the line terminator.
+ * Longer lines are read whole and reported */
 #define MAX_LINE_LENGTH 80
 
-/* Perform the first pass of the assembler */
-void perform_first_pass(const char* filename);
+/* Perform the first pass of the assembler over the macro-expanded program */
+void perform_first_pass(AssemblerContext* context, const ExpandedSource* program);
+
+/* Process one line of the expanded program at the current IC */
+void first_pass_line(AssemblerContext* context, const LineView* line);
 
-#endif /* FIRST_PASS_H */
\ No newline at end of file
+#endif /* FIRST_PASS_H */
@@ -0,0 +1,11 @@
+#include "hash.h"
+
+unsigned int hash_text(const char* text, size_t length) {
+    unsigned int hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
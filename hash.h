@@ -0,0 +1,9 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+/* 32-bit FNV-1a hash of a piece of text, used by the name tables */
+unsigned int hash_text(const char* text, size_t length);
+
+#endif /* HASH_H */
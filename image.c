@@ -0,0 +1,68 @@
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_WORD_CAPACITY 1024
+
+static void init_words(WordBuffer* buffer);
+
+static void init_words(WordBuffer* buffer) {
+    buffer->words = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+}
+
+void init_image(Image* image) {
+    init_words(&image->code);
+    init_words(&image->data);
+}
+
+void clear_image(Image* image) {
+    image->code.count = 0;
+    image->data.count = 0;
+}
+
+void free_image(Image* image) {
+    free(image->code.words);
+    free(image->data.words);
+    init_image(image);
+}
+
+int reserve_words(WordBuffer* buffer, int capacity) {
+    int grown_capacity = buffer->capacity ? buffer->capacity : INITIAL_WORD_CAPACITY;
+    MachineWord* grown;
+
+    if (capacity <= buffer->capacity) return 1;
+
+    while (grown_capacity < capacity) grown_capacity *= 2;
+    grown = realloc(buffer->words, (size_t)grown_capacity * sizeof(MachineWord));
+    if (grown == NULL) return 0;
+    buffer->words = grown;
+    buffer->capacity = grown_capacity;
+    return 1;
+}
+
+int resize_words(WordBuffer* buffer, int count) {
+    if (!reserve_words(buffer, count)) return 0;
+    if (count > buffer->count) {
+        memset(buffer->words + buffer->count, 0, (size_t)(count - buffer->count) * sizeof(MachineWord));
+    }
+    buffer->count = count;
+    return 1;
+}
+
+int place_data(Image* image) {
+    int start = image->code.count;
+
+    if (image->data.count == 0) return 1;
+    if (!resize_words(&image->code, start + image->data.count)) return 0;
+    memcpy(image->code.words + start, image->data.words, (size_t)image->data.count * sizeof(MachineWord));
+    return 1;
+}
+
+int image_bounds_error(const char* file, int line, int index, int limit) {
+    fprintf(stderr, "%s:%d: word %d accessed in a buffer of %d words\n", file, line, index, limit);
+    abort();
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "encoder.h"
+
+/* Words a program may have, code and data together. Addresses start at
+ * 100 and must fit in a 15-bit word. An operand only holds addresses up to
+ * ADDRESS_MAX, the second pass reports a reference to a symbol above it */
+#define IMAGE_MAX_WORDS ((1 << WORD_SIZE) - 100)
+
+/* A growable array of words */
+typedef struct {
+    MachineWord* words;
+    int count;
+    int capacity;
+} WordBuffer;
+
+/* The memory image of one file. Code and data are built apart, as the
+ * code size is only known after the first pass; place_data then moves the
+ * data to the addresses after the code */
+typedef struct {
+    WordBuffer code;    /* code.words[0] is address 100 */
+    WordBuffer data;    /* data.words[0] is DC 0 */
+} Image;
+
+/* Words are only accessed below the count of their buffer. The check stops
+ * the program rather than let a bad address corrupt the heap; building with
+ * IMAGE_UNCHECKED removes it */
+#ifdef IMAGE_UNCHECKED
+#define IMAGE_CHECK(index, limit) (index)
+#else
+#define IMAGE_CHECK(index, limit) \
+    ((unsigned int)(index) < (unsigned int)(limit) ? (index) : image_bounds_error(__FILE__, __LINE__, index, limit))
+#endif
+
+/* The word at index of a buffer, as an lvalue */
+#define IMAGE_WORD(buffer, index) ((buffer)->words[IMAGE_CHECK(index, (buffer)->count)])
+
+/* Append a word to a buffer that reserve_words made room in */
+#define IMAGE_APPEND(buffer, word) \
+    ((buffer)->words[IMAGE_CHECK((buffer)->count, (buffer)->capacity)] = (word), (buffer)->count++)
+
+void init_image(Image* image);
+
+/* Empty both segments but keep their memory */
+void clear_image(Image* image);
+
+void free_image(Image* image);
+
+/* Set the number of words of a buffer, growing it geometrically. New words
+ * are zero. Returns 0 if out of memory */
+int resize_words(WordBuffer* buffer, int count);
+
+/* Make room for capacity words without changing the count, growing
+ * geometrically. Returns 0 if out of memory */
+int reserve_words(WordBuffer* buffer, int capacity);
+
+/* Move the data words to the end of the code, where the addresses of data
+ * symbols point once they are relocated. Returns 0 if out of memory */
+int place_data(Image* image);
+
+/* Report an access outside a buffer and abort */
+int image_bounds_error(const char* file, int line, int index, int limit);
+
+#endif /* IMAGE_H */
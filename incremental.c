@@ -0,0 +1,1008 @@
+#include "incremental.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "operand_validation.h"
+#include "lexer.h"
+#include "keywords.h"
+#include "directives.h"
+#include "source_reader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#define SESSION_NAME "<buffer>"
+#define MESSAGE_PREFIX SESSION_NAME ": error: "
+
+static void* grow_array(void* items, int* capacity, int needed, size_t size);
+static int reserve_lines(IncrementalSession* session, int count);
+static int reserve_pending(IncrementalSession* session, int count);
+static int reserve_symbols(IncrementalSession* session);
+static const char* first_word(const char* text, const char* end, size_t* length);
+static int macro_keyword(const char* text, size_t length);
+static size_t call_limit(const IncrementalSession* session, int macro, int macro_limit);
+static int expand_call(IncrementalSession* session, int macro, const char* arguments, const char* end,
+                       int macro_limit, const char** text, size_t* length);
+static int needs_reload(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length);
+static int reload_with_edit(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length);
+static int keep_messages(SessionLine* line, Diagnostics* diagnostics);
+static int line_label(AssemblerContext* context, const char* text, size_t length, int* symbol, int* was_defined,
+                      int* attribute);
+static int external_symbol(AssemblerContext* context, const char* text, size_t length);
+static int append_words(MachineWord** words, int* count, int* capacity, const MachineWord* added, int added_count);
+static int encode_line(IncrementalSession* session, SessionLine* line, int address, int data_offset, int macro_limit,
+                       int* owned);
+static int refresh_line(IncrementalSession* session, int index);
+static int resolve_label(IncrementalSession* session, int symbol);
+static int lower_bound(const FixupList* fixups, int address);
+static int line_of_address(const IncrementalSession* session, int address);
+static MachineWord fixup_word(const Symbol* symbol, int data_address);
+static int symbol_address(const Symbol* symbol, int data_address);
+static int note_entry_line(SymbolTable* table, const char* text, size_t length, int line_number);
+static void number_entry_lines(IncrementalSession* session);
+static int splice(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length);
+static int macros_define_symbols(const MacroTable* table);
+
+/* Grow an array to hold at least needed items, doubling its capacity.
+ * An array that was never allocated gets room for 64 items even if none
+ * are needed yet. Returns the array, or NULL if out of memory, leaving the
+ * old one alone */
+static void* grow_array(void* items, int* capacity, int needed, size_t size) {
+    int grown_capacity = *capacity ? *capacity : 64;
+    void* grown;
+
+    if (needed <= *capacity && items != NULL) return items;
+    while (grown_capacity < needed) grown_capacity *= 2;
+    grown = realloc(items, (size_t)grown_capacity * size);
+    if (grown != NULL) *capacity = grown_capacity;
+    return grown;
+}
+
+/* Make room for count lines in the parallel line arrays */
+static int reserve_lines(IncrementalSession* session, int count) {
+    int capacity = session->line_capacity;
+    void* grown;
+
+    if (count <= capacity && session->lines != NULL) return 1;
+
+    grown = grow_array(session->lines, &capacity, count, sizeof(SessionLine));
+    if (grown == NULL) return 0;
+    session->lines = grown;
+
+    capacity = session->line_capacity;
+    grown = grow_array(session->addresses, &capacity, count, sizeof(int));
+    if (grown == NULL) return 0;
+    session->addresses = grown;
+
+    capacity = session->line_capacity;
+    grown = grow_array(session->data_offsets, &capacity, count, sizeof(int));
+    if (grown == NULL) return 0;
+    session->data_offsets = grown;
+
+    capacity = session->line_capacity;
+    grown = grow_array(session->owned, &capacity, count, sizeof(int));
+    if (grown == NULL) return 0;
+    session->owned = grown;
+
+    session->line_capacity = capacity;
+    return 1;
+}
+
+/* Make room for count new lines */
+static int reserve_pending(IncrementalSession* session, int count) {
+    int capacity = session->pending_capacity;
+    void* grown;
+
+    if (count <= capacity && session->pending != NULL) return 1;
+
+    grown = grow_array(session->pending, &capacity, count, sizeof(SessionLine));
+    if (grown == NULL) return 0;
+    session->pending = grown;
+
+    capacity = session->pending_capacity;
+    grown = grow_array(session->pending_owned, &capacity, count, sizeof(int));
+    if (grown == NULL) return 0;
+    session->pending_owned = grown;
+
+    session->pending_capacity = capacity;
+    return 1;
+}
+
+/* Keep the bookkeeping as long as the symbol table */
+static int reserve_symbols(IncrementalSession* session) {
+    int count = session->context.symbols.count;
+    int old_capacity = session->symbol_capacity;
+    SessionSymbol* grown;
+
+    if (count <= old_capacity) return 1;
+    grown = grow_array(session->symbols, &session->symbol_capacity, count, sizeof(SessionSymbol));
+    if (grown == NULL) return 0;
+    session->symbols = grown;
+    memset(grown + old_capacity, 0, (size_t)(session->symbol_capacity - old_capacity) * sizeof(SessionSymbol));
+    return 1;
+}
+
+IncrementalSession* session_create(void) {
+    IncrementalSession* session = calloc(1, sizeof(IncrementalSession));
+
+    if (session == NULL) return NULL;
+    init_context(&session->context, SESSION_NAME);
+    init_macro_expander(&session->expander, &session->context.macros);
+    init_diagnostics(&session->macro_messages, SESSION_NAME);
+    init_diagnostics(&session->messages, SESSION_NAME);
+    return session;
+}
+
+static const char* first_word(const char* text, const char* end, size_t* length) {
+    while (text < end && isspace((unsigned char)*text)) text++;
+    *length = word_length(text, end);
+    return text;
+}
+
+/* Get the MacroKeywordType a line starts with, or -1 */
+static int macro_keyword(const char* text, size_t length) {
+    size_t word_size;
+    const char* word = first_word(text, text + length, &word_size);
+    const Keyword* keyword = find_keyword(word, word_size);
+
+    return keyword != NULL && keyword->kind == KEYWORD_MACRO ? keyword->value : -1;
+}
+
+/* Nested calls expand the macros defined before the first macro made
+ * callable on or after line macro_limit, see expand_macro_call. The calls
+ * of other macros do not depend on it */
+static size_t call_limit(const IncrementalSession* session, int macro, int macro_limit) {
+    const MacroTable* table = &session->context.macros;
+    size_t limit = table->macros[macro].defined_at;
+    int i;
+
+    if (!table->macros[macro].calls_macros) return limit;
+    for (i = 0; i < table->count; i++) {
+        if (session->macro_lines[i] < macro_limit && table->macros[i].defined_at > limit) {
+            limit = table->macros[i].defined_at;
+        }
+    }
+    return limit;
+}
+
+/* Expand a call of a macro made callable before line macro_limit, with the
+ * arguments up to end. Errors are not reported, a full run reports them.
+ * Returns one of the MACRO_ results */
+static int expand_call(IncrementalSession* session, int macro, const char* arguments, const char* end,
+                       int macro_limit, const char** text, size_t* length) {
+    return expand_macro_call(&session->expander, macro, arguments, (size_t)(end - arguments),
+                             call_limit(session, macro, macro_limit), NULL, 0, text, length);
+}
+
+/* Macro definitions are expanded as a whole, so an edit that could start,
+ * end or change one reloads the source instead. So does an edit that
+ * removes a symbol attribute, makes a symbol external or adds or removes
+ * a definition of a symbol a .extern line names, which changes lines the
+ * edit does not touch. A call with wrong arguments stops a full run, the
+ * reload reports it */
+static int needs_reload(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length) {
+    SourceFile reader;
+    LineView line;
+    Statement statement;
+    const char* word;
+    const char* expansion;
+    size_t word_size, expansion_length;
+    int symbol, macro;
+    int i;
+
+    if (session->macro_messages.error_count > 0 || session->macro_symbols) return 1;
+    if (first_line > 0 && session->lines[first_line - 1].kind == LINE_MACRO_DEFINITION) return 1;
+    for (i = first_line; i < first_line + removed_count; i++) {
+        if (session->lines[i].kind != LINE_CODE) return 1;
+        if (session->owned[i] >= 0 && session->symbols[session->owned[i]].extern_count > 0) return 1;
+    }
+
+    source_from_buffer(&reader, text, length);
+    while (source_next_line(&reader, &line)) {
+        if (macro_keyword(line.text, line.length) >= 0) return 1;
+
+        word = first_word(line.text, line.text + line.length, &word_size);
+        macro = find_macro(&session->context.macros, word, word_size);
+        if (macro >= 0 && session->macro_lines[macro] < first_line &&
+            expand_call(session, macro, word + word_size, line.text + line.length, first_line, &expansion,
+                        &expansion_length) != MACRO_EXPANDED) {
+            return 1;
+        }
+        lex_line(line.text, line.length, &statement);
+        if (statement.kind == STATEMENT_DIRECTIVE && statement.keyword->value == DIRECTIVE_EXTERN) return 1;
+        if (statement.label_length > 0) {
+            /* The line is going to reference the symbol anyway */
+            symbol = reference_symbol(&session->context.symbols, statement.label, statement.label_length);
+            if (symbol < 0 || !reserve_symbols(session)) return 1;
+            if (session->symbols[symbol].extern_count > 0) return 1;
+        }
+    }
+    return 0;
+}
+
+/* Put the edited source together and load it again */
+static int reload_with_edit(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length) {
+    size_t size = length + 1;
+    char* source;
+    char* out;
+    int ok;
+    int i;
+
+    for (i = 0; i < session->line_count; i++) size += session->lines[i].length + 1;
+    source = malloc(size);
+    if (source == NULL) return 0;
+
+    out = source;
+    for (i = 0; i < first_line; i++) {
+        memcpy(out, session->lines[i].text, session->lines[i].length);
+        out += session->lines[i].length;
+        *out++ = '\n';
+    }
+    memcpy(out, text, length);
+    out += length;
+    if (length > 0 && text[length - 1] != '\n') *out++ = '\n';
+    for (i = first_line + removed_count; i < session->line_count; i++) {
+        memcpy(out, session->lines[i].text, session->lines[i].length);
+        out += session->lines[i].length;
+        *out++ = '\n';
+    }
+
+    ok = session_load(session, source, (size_t)(out - source));
+    free(source);
+    return ok;
+}
+
+/* Keep the messages of a line without their "file: error: " prefix, the
+ * line number is only added when the result is built */
+static int keep_messages(SessionLine* line, Diagnostics* diagnostics) {
+    const char* text;
+    const char* end;
+    const char* newline;
+    size_t prefix = strlen(MESSAGE_PREFIX);
+    char* out;
+
+    free(line->messages);
+    line->messages = NULL;
+    line->messages_length = 0;
+    line->error_count = diagnostics->error_count;
+    if (diagnostics->error_count == 0) return 1;
+    if (!format_diagnostics(diagnostics)) return 0;
+
+    text = diagnostics->text;
+    end = text + diagnostics->length;
+
+    line->messages = malloc(diagnostics->length);
+    if (line->messages == NULL) return 0;
+
+    out = line->messages;
+    while (text < end) {
+        newline = memchr(text, '\n', (size_t)(end - text));
+        if (newline == NULL) newline = end;
+        if ((size_t)(newline - text) >= prefix) text += prefix;
+        memcpy(out, text, (size_t)(newline - text));
+        out += newline - text;
+        *out++ = '\n';
+        text = newline + 1;
+    }
+    line->messages_length = (size_t)(out - line->messages);
+    return 1;
+}
+
+/* Get the symbol the label of a line names, or -1 if it has no label or
+ * the label is ignored, whether the symbol was defined before the line and
+ * the DIRECTIVE_EXTERN or DIRECTIVE_ENTRY of the line, or -1.
+ * Returns 0 if out of memory */
+static int line_label(AssemblerContext* context, const char* text, size_t length, int* symbol, int* was_defined,
+                      int* attribute) {
+    Statement statement;
+
+    *symbol = -1;
+    *was_defined = 1;
+    *attribute = -1;
+    lex_line(text, length, &statement);
+    if (statement.kind == STATEMENT_DIRECTIVE &&
+        (statement.keyword->value == DIRECTIVE_EXTERN || statement.keyword->value == DIRECTIVE_ENTRY)) {
+        *attribute = statement.keyword->value;
+        return 1;
+    }
+    if (statement.label_length == 0) return 1;
+
+    *symbol = reference_symbol(&context->symbols, statement.label, statement.label_length);
+    if (*symbol < 0) return 0;
+    *was_defined = context->symbols.symbols[*symbol].is_defined || context->symbols.symbols[*symbol].is_external;
+    return 1;
+}
+
+/* Get the symbol a .extern line names, or -1 if the name is not valid */
+static int external_symbol(AssemblerContext* context, const char* text, size_t length) {
+    Statement statement;
+
+    lex_line(text, length, &statement);
+    if (check_symbol_argument(statement.arguments, statement.arguments_length) != ARGUMENTS_VALID) return -1;
+    return reference_symbol(&context->symbols, statement.arguments, statement.arguments_length);
+}
+
+/* Append added_count words to a growable array of words */
+static int append_words(MachineWord** words, int* count, int* capacity, const MachineWord* added, int added_count) {
+    void* grown = grow_array(*words, capacity, *count + added_count, sizeof(MachineWord));
+
+    if (grown == NULL) return 0;
+    *words = grown;
+    if (added_count > 0) memcpy(*words + *count, added, (size_t)added_count * sizeof(MachineWord));
+    *count += added_count;
+    return 1;
+}
+
+/* Run the first pass over a line as if it started at address and at
+ * data_offset in the data, appending its words, data and fixups to the
+ * pending ones. A macro call is encoded as its body, if the macro was
+ * defined on a line before macro_limit.
+ * Sets owned to the symbol the label of the line defines, or -1 */
+static int encode_line(IncrementalSession* session, SessionLine* line, int address, int data_offset, int macro_limit,
+                       int* owned) {
+    AssemblerContext* context = &session->context;
+    const char* word;
+    size_t length;
+    int was_defined, attribute, external = -1;
+    int macro = -1;
+    int body_label, body_defined, start, data_start;
+    const char* expansion;
+    size_t expansion_length;
+    SourceFile body;
+    LineView view;
+    Symbol* symbol;
+    int i;
+
+    context->IC = 100;
+    context->DC = 0;
+    context->image.data.count = 0;
+    context->instructions.count = 0;
+    context->fixups.count = 0;
+    clear_diagnostics(&context->diagnostics);
+
+    /* Look at the label before the first pass defines it, to tell a new
+     * definition from a duplicate one */
+    if (!line_label(context, line->text, line->length, &line->label, &was_defined, &attribute)) return 0;
+    if (attribute >= 0) line->kind = LINE_ATTRIBUTE;
+    if (attribute == DIRECTIVE_EXTERN) external = external_symbol(context, line->text, line->length);
+    if (line->label < 0 && attribute < 0) {
+        word = first_word(line->text, line->text + line->length, &length);
+        macro = find_macro(&context->macros, word, length);
+        if (macro >= 0 && session->macro_lines[macro] >= macro_limit) macro = -1;
+    }
+
+    /* Lines are encoded without a line number, see keep_messages */
+    if (macro >= 0) {
+        if (expand_call(session, macro, word + length, line->text + line->length, macro_limit, &expansion,
+                        &expansion_length) == MACRO_NO_MEMORY) {
+            return 0;
+        }
+        source_from_buffer(&body, expansion, expansion_length);
+        while (source_next_line(&body, &view)) {
+            start = context->IC;
+            data_start = context->DC;
+            if (!line_label(context, view.text, view.length, &body_label, &body_defined, &attribute)) return 0;
+            view.line_number = 0;
+            first_pass_line(context, &view);
+
+            /* Sources with such labels are loaded again on every edit, so
+             * only their address has to be right */
+            if (body_label >= 0 && !body_defined && context->symbols.symbols[body_label].is_defined) {
+                symbol = &context->symbols.symbols[body_label];
+                symbol->address = symbol->is_data ? data_offset + data_start : address + start - 100;
+            }
+        }
+    } else {
+        view.text = line->text;
+        view.length = line->length;
+        view.line_number = 0;
+        view.offset = 0;
+        first_pass_line(context, &view);
+    }
+    encode_program(context);
+    if (!reserve_symbols(session)) return 0;
+    if (external >= 0) session->symbols[external].extern_count++;
+
+    *owned = -1;
+    if (line->label >= 0 && !was_defined && context->symbols.symbols[line->label].is_defined) {
+        symbol = &context->symbols.symbols[line->label];
+        symbol->address = symbol->is_data ? data_offset : address;
+        *owned = line->label;
+    }
+
+    line->word_count = context->IC - 100;
+    line->data_count = context->image.data.count;
+    if (!append_words(&session->pending_words, &session->pending_word_count, &session->pending_word_capacity,
+                      context->image.code.words, line->word_count) ||
+        !append_words(&session->pending_data, &session->pending_data_count, &session->pending_data_capacity,
+                      context->image.data.words, line->data_count)) {
+        return 0;
+    }
+
+    for (i = 0; i < context->fixups.count; i++) {
+        if (!add_fixup(&session->pending_fixups, context->fixups.items[i].address - 100 + address,
+                       context->fixups.items[i].symbol, 0)) {
+            return 0;
+        }
+    }
+
+    return keep_messages(line, &context->diagnostics);
+}
+
+/* Encode a line again in place, only for its messages and its label.
+ * Its words, data and fixups cannot have changed */
+static int refresh_line(IncrementalSession* session, int index) {
+    SessionLine* line = &session->lines[index];
+    int pending_words = session->pending_word_count;
+    int pending_data = session->pending_data_count;
+    int pending_fixups = session->pending_fixups.count;
+    int ok;
+
+    session->line_error_count -= line->error_count;
+    ok = encode_line(session, line, session->addresses[index], session->data_offsets[index], index,
+                     &session->owned[index]);
+    session->line_error_count += line->error_count;
+
+    session->pending_word_count = pending_words;
+    session->pending_data_count = pending_data;
+    session->pending_fixups.count = pending_fixups;
+    return ok;
+}
+
+/* Make the first line whose label names symbol its definition, and every
+ * other such line a duplicate, as assembling the whole source would */
+static int resolve_label(IncrementalSession* session, int symbol) {
+    Symbol* defined = &session->context.symbols.symbols[symbol];
+    int first = -1;
+    int owner = -1;
+    int i;
+
+    for (i = 0; i < session->line_count && (first < 0 || owner < 0); i++) {
+        if (first < 0 && session->lines[i].label == symbol) first = i;
+        if (session->owned[i] == symbol) owner = i;
+    }
+    if (first < 0 || first == owner || defined->is_external) return 1;
+
+    defined->is_defined = 0;
+    if (owner >= 0) session->owned[owner] = -1;
+    if (!refresh_line(session, first)) return 0;
+    if (owner >= 0 && !refresh_line(session, owner)) return 0;
+    session->symbols[symbol].stamp = session->stamp;
+    return 1;
+}
+
+/* Index of the first fixup at or after address */
+static int lower_bound(const FixupList* fixups, int address) {
+    int low = 0, high = fixups->count, middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (fixups->items[middle].address < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* Index of the line a word belongs to: the last line starting at or before it */
+static int line_of_address(const IncrementalSession* session, int address) {
+    int low = 0, high = session->line_count, middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (session->addresses[middle] <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+/* The word a fixup gets, as the second pass patches it. The data starts
+ * at data_address */
+static MachineWord fixup_word(const Symbol* symbol, int data_address) {
+    int address = symbol_address(symbol, data_address);
+
+    if (symbol->is_external) return ARE_EXTERNAL;
+    if (symbol->is_defined && address <= ADDRESS_MAX) {
+        return (MachineWord)(((address << 3) | ARE_RELOCATABLE) & 0x7FFF);
+    }
+    return 0;
+}
+
+/* The address of a symbol once the data starts at data_address */
+static int symbol_address(const Symbol* symbol, int data_address) {
+    return symbol->is_data ? data_address + symbol->address : symbol->address;
+}
+
+/* Give the symbol a .entry line names the line number, if it is an entry
+ * that is not defined and no earlier line named it.
+ * Returns 1 if the line number was given */
+static int note_entry_line(SymbolTable* table, const char* text, size_t length, int line_number) {
+    Statement statement;
+    Symbol* symbol;
+    int index;
+
+    lex_line(text, length, &statement);
+    if (statement.kind != STATEMENT_DIRECTIVE || statement.keyword->value != DIRECTIVE_ENTRY ||
+        check_symbol_argument(statement.arguments, statement.arguments_length) != ARGUMENTS_VALID) {
+        return 0;
+    }
+    index = reference_symbol(table, statement.arguments, statement.arguments_length);
+    if (index < 0) return 0;
+
+    symbol = &table->symbols[index];
+    if (!symbol->is_entry || symbol->is_defined || symbol->entry_line > 0) return 0;
+    symbol->entry_line = line_number;
+    return 1;
+}
+
+/* Lines are encoded without a line number, so the first .entry line of
+ * each entry that is not defined is looked up again for its message,
+ * the line of the call for a .entry in a macro body as in a full run */
+static void number_entry_lines(IncrementalSession* session) {
+    SymbolTable* table = &session->context.symbols;
+    const SessionLine* line;
+    const char* word;
+    const char* expansion;
+    size_t length, expansion_length;
+    SourceFile body;
+    LineView view;
+    int missing = 0;
+    int macro;
+    int i;
+
+    for (i = 0; i < table->count; i++) {
+        if (table->symbols[i].is_entry && !table->symbols[i].is_defined) {
+            table->symbols[i].entry_line = 0;
+            missing++;
+        }
+    }
+
+    for (i = 0; i < session->line_count && missing > 0; i++) {
+        line = &session->lines[i];
+        if (line->kind == LINE_ATTRIBUTE) {
+            missing -= note_entry_line(table, line->text, line->length, i + 1);
+            continue;
+        }
+        if (line->kind != LINE_CODE || line->label >= 0) continue;
+
+        /* The same calls encode_line expands */
+        word = first_word(line->text, line->text + line->length, &length);
+        macro = find_macro(&session->context.macros, word, length);
+        if (macro < 0 || session->macro_lines[macro] >= i ||
+            expand_call(session, macro, word + length, line->text + line->length, i, &expansion,
+                        &expansion_length) != MACRO_EXPANDED) {
+            continue;
+        }
+        source_from_buffer(&body, expansion, expansion_length);
+        while (source_next_line(&body, &view)) {
+            missing -= note_entry_line(table, view.text, view.length, i + 1);
+        }
+    }
+}
+
+/* Replace lines by the lines of text. The new lines are encoded into the
+ * pending buffers at the addresses they will have, then the code, the
+ * data, the fixups and the line arrays are each spliced with one move */
+static int splice(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length) {
+    AssemblerContext* context = &session->context;
+    Symbol* symbols;
+    SessionLine* line;
+    SourceFile reader;
+    LineView view;
+    void* grown;
+    int region_start, address, old_words = 0, new_words, delta;
+    int data_start, data_offset, old_data = 0, new_data, data_delta;
+    int in_definition = 0, changed = 0, tail, low, high, i;
+    int new_fixups;
+    int loading = session->line_count == 0; /* Lines come in order, nothing to resolve */
+    const char* macro_name = NULL;
+    size_t name_length = 0;
+    int macro;
+
+    session->stamp++;
+    session->pending_count = 0;
+    session->pending_word_count = 0;
+    session->pending_data_count = 0;
+    session->pending_fixups.count = 0;
+    session->unresolved_count = 0;
+
+    region_start = first_line < session->line_count ? session->addresses[first_line] : 100 + session->word_count;
+    data_start = first_line < session->line_count ? session->data_offsets[first_line] : session->data_count;
+
+    /* Forget what the removed lines defined */
+    for (i = first_line; i < first_line + removed_count; i++) {
+        line = &session->lines[i];
+        old_words += line->word_count;
+        old_data += line->data_count;
+        if (line->label >= 0) session->symbols[line->label].label_count--;
+        if (session->owned[i] >= 0) {
+            context->symbols.symbols[session->owned[i]].is_defined = 0;
+            context->symbols.symbols[session->owned[i]].address = 0;
+            session->symbols[session->owned[i]].stamp = session->stamp;
+            changed++;
+            if (session->symbols[session->owned[i]].label_count > 0) {
+                grown = grow_array(session->unresolved, &session->unresolved_capacity,
+                                   session->unresolved_count + 1, sizeof(int));
+                if (grown == NULL) return 0;
+                session->unresolved = grown;
+                session->unresolved[session->unresolved_count++] = session->owned[i];
+            }
+        }
+    }
+
+    /* Encode the new lines at the addresses they are going to have */
+    address = region_start;
+    data_offset = data_start;
+    source_from_buffer(&reader, text, length);
+    while (source_next_line(&reader, &view)) {
+        if (!reserve_pending(session, session->pending_count + 1)) return 0;
+
+        line = &session->pending[session->pending_count];
+        line->text = malloc(view.length + 1);
+        if (line->text == NULL) return 0;
+        memcpy(line->text, view.text, view.length);
+        line->text[view.length] = '\0';
+        line->length = view.length;
+        line->messages = NULL;
+        line->messages_length = 0;
+        line->error_count = 0;
+        line->label = -1;
+        line->word_count = 0;
+        line->data_count = 0;
+        session->pending_owned[session->pending_count] = -1;
+        session->pending_count++;
+
+        /* Follow macro definitions the way expand_macros does */
+        switch (macro_keyword(view.text, view.length)) {
+            case MACRO_START:
+                line->kind = LINE_MACRO_DEFINITION;
+                in_definition = 1;
+                macro_name = first_word(line->text, line->text + line->length, &name_length) + name_length;
+                macro_name = first_word(macro_name, line->text + line->length, &name_length);
+                continue;
+            case MACRO_END:
+                /* The first complete definition of a name is the one kept */
+                line->kind = LINE_MACRO_END;
+                if (in_definition) {
+                    macro = find_macro(&context->macros, macro_name, name_length);
+                    if (macro >= 0 && session->macro_lines[macro] == INT_MAX) {
+                        session->macro_lines[macro] = first_line + session->pending_count - 1;
+                    }
+                }
+                in_definition = 0;
+                continue;
+        }
+        line->kind = in_definition ? LINE_MACRO_DEFINITION : LINE_CODE;
+        if (in_definition) continue;
+
+        /* An edit cannot add a definition, only macros before it are callable */
+        if (!encode_line(session, line, address, data_offset,
+                         loading ? first_line + session->pending_count - 1 : first_line,
+                         &session->pending_owned[session->pending_count - 1])) {
+            return 0;
+        }
+        if (line->label >= 0) {
+            symbols = context->symbols.symbols;
+            session->symbols[line->label].label_count++;
+            if (session->pending_owned[session->pending_count - 1] >= 0) {
+                session->symbols[line->label].stamp = session->stamp;
+                changed++;
+            } else if (!loading && !symbols[line->label].is_external &&
+                       symbols[line->label].address >= (symbols[line->label].is_data ? data_start : region_start)) {
+                /* Defined twice, and the definition may come after this line */
+                grown = grow_array(session->unresolved, &session->unresolved_capacity,
+                                   session->unresolved_count + 1, sizeof(int));
+                if (grown == NULL) return 0;
+                session->unresolved = grown;
+                session->unresolved[session->unresolved_count++] = line->label;
+            }
+        }
+        address += line->word_count;
+        data_offset += line->data_count;
+    }
+
+    new_words = address - region_start;
+    delta = new_words - old_words;
+    new_data = data_offset - data_start;
+    data_delta = new_data - old_data;
+
+    /* Splice the data */
+    grown = grow_array(session->data, &session->data_capacity, session->data_count + data_delta, sizeof(MachineWord));
+    if (grown == NULL) return 0;
+    session->data = grown;
+    tail = session->data_count - data_start - old_data;
+    memmove(session->data + data_start + new_data, session->data + data_start + old_data,
+            (size_t)tail * sizeof(MachineWord));
+    if (new_data > 0) {
+        memcpy(session->data + data_start, session->pending_data, (size_t)new_data * sizeof(MachineWord));
+    }
+    session->data_count += data_delta;
+
+    /* Splice the code, leaving room to append the data */
+    grown = grow_array(session->words, &session->word_capacity, session->word_count + delta + session->data_count,
+                       sizeof(MachineWord));
+    if (grown == NULL) return 0;
+    session->words = grown;
+    tail = session->word_count - (region_start - 100) - old_words;
+    memmove(session->words + (region_start - 100) + new_words, session->words + (region_start - 100) + old_words,
+            (size_t)tail * sizeof(MachineWord));
+    if (new_words > 0) {
+        memcpy(session->words + (region_start - 100), session->pending_words, (size_t)new_words * sizeof(MachineWord));
+    }
+    session->word_count += delta;
+
+    /* Splice the fixups, which stay sorted by address */
+    low = lower_bound(&session->fixups, region_start);
+    high = lower_bound(&session->fixups, region_start + old_words);
+    new_fixups = session->pending_fixups.count;
+    grown = grow_array(session->fixups.items, &session->fixups.capacity,
+                       session->fixups.count - (high - low) + new_fixups, sizeof(Fixup));
+    if (grown == NULL) return 0;
+    session->fixups.items = grown;
+    memmove(session->fixups.items + low + new_fixups, session->fixups.items + high,
+            (size_t)(session->fixups.count - high) * sizeof(Fixup));
+    if (new_fixups > 0) {
+        memcpy(session->fixups.items + low, session->pending_fixups.items, (size_t)new_fixups * sizeof(Fixup));
+    }
+    session->fixups.count += new_fixups - (high - low);
+
+    /* Splice the lines */
+    for (i = first_line; i < first_line + removed_count; i++) {
+        session->line_error_count -= session->lines[i].error_count;
+        free(session->lines[i].text);
+        free(session->lines[i].messages);
+    }
+    if (!reserve_lines(session, session->line_count - removed_count + session->pending_count)) return 0;
+    tail = session->line_count - first_line - removed_count;
+    memmove(session->lines + first_line + session->pending_count, session->lines + first_line + removed_count,
+            (size_t)tail * sizeof(SessionLine));
+    memmove(session->addresses + first_line + session->pending_count, session->addresses + first_line + removed_count,
+            (size_t)tail * sizeof(int));
+    memmove(session->data_offsets + first_line + session->pending_count,
+            session->data_offsets + first_line + removed_count, (size_t)tail * sizeof(int));
+    memmove(session->owned + first_line + session->pending_count, session->owned + first_line + removed_count,
+            (size_t)tail * sizeof(int));
+    if (session->pending_count > 0) {
+        memcpy(session->lines + first_line, session->pending, (size_t)session->pending_count * sizeof(SessionLine));
+        memcpy(session->owned + first_line, session->pending_owned, (size_t)session->pending_count * sizeof(int));
+    }
+    address = region_start;
+    data_offset = data_start;
+    for (i = first_line; i < first_line + session->pending_count; i++) {
+        session->addresses[i] = address;
+        session->data_offsets[i] = data_offset;
+        address += session->lines[i].word_count;
+        data_offset += session->lines[i].data_count;
+        session->line_error_count += session->lines[i].error_count;
+    }
+    session->line_count += session->pending_count - removed_count;
+    if (!loading) {
+        for (i = 0; i < context->macros.count; i++) {
+            if (session->macro_lines[i] != INT_MAX && session->macro_lines[i] >= first_line + removed_count) {
+                session->macro_lines[i] += session->pending_count - removed_count;
+            }
+        }
+    }
+
+    /* Everything after the edit moves by the change in size. Data symbols
+     * keep their offset in the data when only the code changes size */
+    symbols = context->symbols.symbols;
+    if (delta != 0 || data_delta != 0) {
+        for (i = first_line + session->pending_count; i < session->line_count; i++) {
+            session->addresses[i] += delta;
+            session->data_offsets[i] += data_delta;
+            if (session->owned[i] >= 0 && (symbols[session->owned[i]].is_data ? data_delta : delta) != 0) {
+                symbols[session->owned[i]].address += symbols[session->owned[i]].is_data ? data_delta : delta;
+                session->symbols[session->owned[i]].stamp = session->stamp;
+                changed++;
+            }
+        }
+    }
+
+    /* Labels that lost their definition or were defined twice */
+    for (i = 0; i < session->unresolved_count; i++) {
+        if (!resolve_label(session, session->unresolved[i])) return 0;
+        changed++;
+    }
+
+    /* Patch the new fixups and the fixups of symbols that changed, where a
+     * change in the size of the code moves every data symbol. If no symbol
+     * changed, the fixups of the new lines are all there is to do */
+    symbols = context->symbols.symbols;
+    address = 100 + session->word_count;
+    if (changed == 0 && delta == 0) {
+        for (i = low; i < low + new_fixups; i++) {
+            session->words[session->fixups.items[i].address - 100] =
+                    fixup_word(&symbols[session->fixups.items[i].symbol], address);
+        }
+        return 1;
+    }
+    for (i = 0; i < session->fixups.count; i++) {
+        Fixup* fixup = &session->fixups.items[i];
+
+        if (i >= low + new_fixups) fixup->address += delta;
+        if ((i >= low && i < low + new_fixups) || session->symbols[fixup->symbol].stamp == session->stamp ||
+            (delta != 0 && symbols[fixup->symbol].is_data)) {
+            session->words[fixup->address - 100] = fixup_word(&symbols[fixup->symbol], address);
+        }
+    }
+    return 1;
+}
+
+/* Every call of a macro whose body has a label defines that label again,
+ * and a body may mark symbols external or entry. The per-line bookkeeping
+ * follows neither */
+static int macros_define_symbols(const MacroTable* table) {
+    SourceFile body;
+    LineView line;
+    Statement statement;
+    int i;
+
+    for (i = 0; i < table->count; i++) {
+        source_from_buffer(&body, table->macros[i].content, table->macros[i].content_length);
+        while (source_next_line(&body, &line)) {
+            lex_line(line.text, line.length, &statement);
+            if (statement.label_length > 0) return 1;
+            if (statement.kind == STATEMENT_DIRECTIVE &&
+                (statement.keyword->value == DIRECTIVE_EXTERN || statement.keyword->value == DIRECTIVE_ENTRY)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int session_load(IncrementalSession* session, const char* source, size_t length) {
+    SourceFile reader;
+    void* grown;
+    int i;
+
+    for (i = 0; i < session->line_count; i++) {
+        free(session->lines[i].text);
+        free(session->lines[i].messages);
+    }
+    session->line_count = 0;
+    session->word_count = 0;
+    session->data_count = 0;
+    session->fixups.count = 0;
+    session->line_error_count = 0;
+    reset_context(&session->context);
+    clear_macro_expander(&session->expander);
+    clear_diagnostics(&session->macro_messages);
+    if (session->symbols != NULL) {
+        memset(session->symbols, 0, (size_t)session->symbol_capacity * sizeof(SessionSymbol));
+    }
+
+    /* The macro table comes from a regular expansion, which also reports
+     * errors in the definitions */
+    source_from_buffer(&reader, source, length);
+    if (!expand_macros(&session->context.macros, &session->macro_messages, &reader, &session->context.program, 1)) {
+        return 0;
+    }
+    session->macro_symbols = macros_define_symbols(&session->context.macros);
+
+    /* Filled in as the endmacr lines are met */
+    grown = grow_array(session->macro_lines, &session->macro_line_capacity, session->context.macros.count, sizeof(int));
+    if (grown == NULL) return 0;
+    session->macro_lines = grown;
+    for (i = 0; i < session->context.macros.count; i++) {
+        session->macro_lines[i] = INT_MAX;
+    }
+    return splice(session, 0, 0, source, length);
+}
+
+int session_edit(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length) {
+    if (first_line < 0 || removed_count < 0 || first_line + removed_count > session->line_count) return 0;
+
+    if (needs_reload(session, first_line, removed_count, text, length)) {
+        return reload_with_edit(session, first_line, removed_count, text, length);
+    }
+    return splice(session, first_line, removed_count, text, length);
+}
+
+int session_result(IncrementalSession* session, AssemblyResult* result) {
+    AssemblerContext* context = &session->context;
+    const Symbol* symbol;
+    const SessionLine* line;
+    const char* message;
+    const char* end;
+    const char* newline;
+    int i;
+
+    clear_diagnostics(&session->messages);
+    context->entries.count = 0;
+    context->externals.count = 0;
+    /* splice leaves room for the data after the code */
+    if (session->data_count > 0) {
+        memcpy(session->words + session->word_count, session->data, (size_t)session->data_count * sizeof(MachineWord));
+    }
+    result->words = session->words;
+    result->word_count = session->word_count + session->data_count;
+
+    /* As in a full run, errors in macro definitions stop the assembly */
+    if (session->macro_messages.error_count > 0) {
+        result->word_count = 0;
+        result->entries = NULL;
+        result->entry_count = 0;
+        result->externals = NULL;
+        result->external_count = 0;
+        format_diagnostics(&session->macro_messages);
+        result->messages = session->macro_messages.text;
+        result->messages_length = session->macro_messages.length;
+        result->error_count = session->macro_messages.error_count;
+        return 0;
+    }
+
+    for (i = 0; i < session->line_count && session->line_error_count > 0; i++) {
+        line = &session->lines[i];
+        message = line->messages;
+        end = message + line->messages_length;
+        while (message < end) {
+            newline = memchr(message, '\n', (size_t)(end - message));
+            report_error(&session->messages, i + 1, "%.*s", (int)(newline - message), message);
+            message = newline + 1;
+        }
+    }
+
+    /* What the second pass reports, in the same order */
+    for (i = 0; i < session->fixups.count; i++) {
+        symbol = &context->symbols.symbols[session->fixups.items[i].symbol];
+        if (symbol->is_external) {
+            add_reference(&context->externals, symbol->name, session->fixups.items[i].address);
+        } else if (!symbol->is_defined) {
+            report_error(&session->messages, line_of_address(session, session->fixups.items[i].address) + 1,
+                         "Undefined symbol '%s'", symbol->name);
+        } else if (symbol_address(symbol, 100 + session->word_count) > ADDRESS_MAX) {
+            report_error(&session->messages, line_of_address(session, session->fixups.items[i].address) + 1,
+                         "Address %d of symbol '%s' does not fit in an operand word",
+                         symbol_address(symbol, 100 + session->word_count), symbol->name);
+        }
+    }
+    number_entry_lines(session);
+    collect_entries(&context->symbols, 100 + session->word_count, &context->entries, &session->messages);
+
+    result->entries = context->entries.items;
+    result->entry_count = context->entries.count;
+    result->externals = context->externals.items;
+    result->external_count = context->externals.count;
+    format_diagnostics(&session->messages);
+    result->messages = session->messages.text;
+    result->messages_length = session->messages.length;
+    result->error_count = session->messages.error_count;
+    return result->error_count == 0;
+}
+
+void session_destroy(IncrementalSession* session) {
+    int i;
+
+    if (session == NULL) return;
+    for (i = 0; i < session->line_count; i++) {
+        free(session->lines[i].text);
+        free(session->lines[i].messages);
+    }
+    free_context(&session->context);
+    free_macro_expander(&session->expander);
+    free_diagnostics(&session->macro_messages);
+    free_diagnostics(&session->messages);
+    free(session->lines);
+    free(session->addresses);
+    free(session->data_offsets);
+    free(session->owned);
+    free(session->words);
+    free(session->data);
+    free(session->fixups.items);
+    free(session->symbols);
+    free(session->pending);
+    free(session->pending_owned);
+    free(session->pending_words);
+    free(session->pending_data);
+    free(session->pending_fixups.items);
+    free(session->unresolved);
+    free(session->macro_lines);
+    free(session);
+}
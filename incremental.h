@@ -0,0 +1,114 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include "assembler.h"
+#include "assembler_api.h"
+
+/* Kinds of source lines */
+#define LINE_CODE 0              /* Assembled, possibly as a macro call */
+#define LINE_MACRO_DEFINITION 1  /* macr line or part of a macro body */
+#define LINE_MACRO_END 2         /* endmacr line */
+#define LINE_ATTRIBUTE 3         /* .extern or .entry line */
+
+/* What a session remembers about one source line */
+typedef struct {
+    char* text;              /* Copy of the line, without the line terminator */
+    size_t length;
+    char* messages;          /* Errors of the line without line numbers, or NULL */
+    size_t messages_length;
+    int error_count;
+    int label;               /* Symbol named by the label of the line, or -1 */
+    int word_count;          /* Words the line adds to the code */
+    int data_count;          /* Words the line adds to the data */
+    int kind;
+} SessionLine;
+
+/* Per-symbol bookkeeping, indexed like the symbol table */
+typedef struct {
+    unsigned int stamp;      /* Edit that last changed the symbol */
+    int label_count;         /* Lines whose label names the symbol */
+    int extern_count;        /* .extern lines naming the symbol */
+} SessionSymbol;
+
+/* A source kept in memory together with the parse and encoding results of
+ * every line, so that an edit only re-encodes the lines it touches.
+ * The lines, their addresses and the symbols they own are kept in parallel
+ * arrays; addresses[], data_offsets[] and owned[] are the only per-line
+ * data an edit walks past the edited lines. The code, the data and the
+ * fixups are kept in address order and are spliced with a single move each.
+ * Data symbols hold their offset in the data, the data follows the code */
+typedef struct {
+    AssemblerContext context;   /* Symbol and macro tables, scratch for encoding */
+    SessionLine* lines;
+    int* addresses;             /* Address of the first word of each line */
+    int* data_offsets;          /* Offset of the first data word of each line */
+    int* owned;                 /* Symbol defined by each line, or -1 */
+    int line_count;
+    int line_capacity;
+    MachineWord* words;         /* The code image, words[0] is address 100 */
+    int word_count;
+    int word_capacity;          /* Room for the data too, see session_result */
+    MachineWord* data;
+    int data_count;
+    int data_capacity;
+    FixupList fixups;           /* Sorted by address */
+    SessionSymbol* symbols;
+    int symbol_capacity;
+    unsigned int stamp;
+    int line_error_count;       /* Errors of all lines together */
+    int macro_symbols;          /* A macro body defines labels or attributes */
+    int* macro_lines;           /* Line of the endmacr that made each macro callable */
+    int macro_line_capacity;
+    MacroExpander expander;     /* Calls with arguments or nested calls, kept until the next load */
+
+    /* Lines being inserted by the current edit */
+    SessionLine* pending;
+    int pending_count;
+    int pending_capacity;
+    int* pending_owned;
+    MachineWord* pending_words;
+    int pending_word_count;
+    int pending_word_capacity;
+    MachineWord* pending_data;
+    int pending_data_count;
+    int pending_data_capacity;
+    FixupList pending_fixups;
+
+    /* Symbols whose defining line has to be worked out again */
+    int* unresolved;
+    int unresolved_count;
+    int unresolved_capacity;
+
+    /* Errors of the macro definitions, with line numbers */
+    Diagnostics macro_messages;
+
+    /* Result buffers, rebuilt by session_result */
+    Diagnostics messages;
+} IncrementalSession;
+
+/* Create an empty session, NULL if out of memory */
+IncrementalSession* session_create(void);
+
+/* Replace the whole source. Returns 0 if out of memory */
+int session_load(IncrementalSession* session, const char* source, size_t length);
+
+/* Replace removed_count lines starting at the 0-based first_line with the
+ * lines of text, which may be empty to only delete lines. Only the new lines
+ * are encoded; later lines and their labels move by the change in size and
+ * only fixups of symbols that changed are patched again. Edits that touch a
+ * macro definition or remove an .extern or .entry line fall back to
+ * reloading the whole source, and so do edits adding an .extern line and
+ * every edit of a source whose macros define labels or symbol attributes.
+ * Returns 0 if the lines are out of range or out of memory; after running
+ * out of memory the source has to be loaded again */
+int session_edit(IncrementalSession* session, int first_line, int removed_count, const char* text, size_t length);
+
+/* Get the result for the current source, in the form asm_assemble_buffer
+ * gives it. It stays valid until the next edit.
+ * Returns 1 if the source has no errors */
+int session_result(IncrementalSession* session, AssemblyResult* result);
+
+void session_destroy(IncrementalSession* session);
+
+#endif /* INCREMENTAL_H */
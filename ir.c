@@ -0,0 +1,74 @@
+#include "ir.h"
+#include <stdlib.h>
+
+#define INITIAL_INSTRUCTION_CAPACITY 256
+
+/* Grow every array to capacity. The capacity only changes once all of them
+ * grew, an array that grew before a failure just has room to spare */
+int reserve_instructions(InstructionList* list, int capacity) {
+    void* grown;
+
+    if (capacity <= list->capacity) return 1;
+
+    grown = realloc(list->opcodes, (size_t)capacity * sizeof(unsigned char));
+    if (grown == NULL) return 0;
+    list->opcodes = grown;
+    grown = realloc(list->modes, (size_t)capacity * sizeof(unsigned char));
+    if (grown == NULL) return 0;
+    list->modes = grown;
+    grown = realloc(list->sources, (size_t)capacity * sizeof(int));
+    if (grown == NULL) return 0;
+    list->sources = grown;
+    grown = realloc(list->destinations, (size_t)capacity * sizeof(int));
+    if (grown == NULL) return 0;
+    list->destinations = grown;
+    grown = realloc(list->addresses, (size_t)capacity * sizeof(int));
+    if (grown == NULL) return 0;
+    list->addresses = grown;
+    grown = realloc(list->lines, (size_t)capacity * sizeof(int));
+    if (grown == NULL) return 0;
+    list->lines = grown;
+
+    list->capacity = capacity;
+    return 1;
+}
+
+void init_instructions(InstructionList* list) {
+    list->opcodes = NULL;
+    list->modes = NULL;
+    list->sources = NULL;
+    list->destinations = NULL;
+    list->addresses = NULL;
+    list->lines = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+int add_instruction(InstructionList* list, int opcode, int modes, int source, int destination,
+                    int address, int line_number) {
+    int i = list->count;
+
+    if (i == list->capacity &&
+        !reserve_instructions(list, list->capacity ? list->capacity * 2 : INITIAL_INSTRUCTION_CAPACITY)) {
+        return 0;
+    }
+
+    list->opcodes[i] = (unsigned char)opcode;
+    list->modes[i] = (unsigned char)modes;
+    list->sources[i] = source;
+    list->destinations[i] = destination;
+    list->addresses[i] = address;
+    list->lines[i] = line_number;
+    list->count++;
+    return 1;
+}
+
+void free_instructions(InstructionList* list) {
+    free(list->opcodes);
+    free(list->modes);
+    free(list->sources);
+    free(list->destinations);
+    free(list->addresses);
+    free(list->lines);
+    init_instructions(list);
+}
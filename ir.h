@@ -0,0 +1,43 @@
+#ifndef IR_H
+#define IR_H
+
+/* Fields of InstructionList.modes: the addressing method of each operand
+ * and which operands the instruction has */
+#define IR_DESTINATION_MODE(modes) ((modes) & 3)
+#define IR_SOURCE_MODE(modes) (((modes) >> 2) & 3)
+#define IR_HAS_DESTINATION 0x10
+#define IR_HAS_SOURCE 0x20
+#define IR_MODES(source_mode, destination_mode) (((source_mode) << 2) | (destination_mode))
+
+/* The instructions the first pass found, in address order, kept as
+ * parallel arrays so that a pass touches only the fields it needs.
+ * An operand payload is an immediate value, a register number or the
+ * index of a symbol, depending on the addressing method.
+ * Every instruction takes 18 bytes: 1 for the opcode, 1 for the modes,
+ * 4 for each payload, 4 for the address and 4 for the source line */
+typedef struct {
+    unsigned char* opcodes;
+    unsigned char* modes;
+    int* sources;        /* Payload of the source operand */
+    int* destinations;   /* Payload of the destination operand */
+    int* addresses;      /* Address of the first word */
+    int* lines;          /* Source line, for diagnostics */
+    int count;
+    int capacity;
+} InstructionList;
+
+/* Bytes each instruction takes in an InstructionList */
+#define IR_INSTRUCTION_SIZE (2 * sizeof(unsigned char) + 4 * sizeof(int))
+
+void init_instructions(InstructionList* list);
+
+/* Make room for capacity instructions in all arrays, returns 0 if out of memory */
+int reserve_instructions(InstructionList* list, int capacity);
+
+/* Append an instruction, returns 0 if out of memory */
+int add_instruction(InstructionList* list, int opcode, int modes, int source, int destination,
+                    int address, int line_number);
+
+void free_instructions(InstructionList* list);
+
+#endif /* IR_H */
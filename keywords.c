@@ -0,0 +1,107 @@
+#include "keywords.h"
+#include <string.h>
+
+#define SRC_ALL MODE_ANY
+#define DST_ALL MODE_ANY
+#define DST_WRITABLE (MODE_DIRECT | MODE_INDEX | MODE_REGISTER)
+#define DST_JUMP (MODE_DIRECT | MODE_INDEX)
+
+/* Indices into keyword_table, used by the classifier below */
+enum {
+    KW_MOV, KW_CMP, KW_ADD, KW_SUB, KW_LEA, KW_CLR, KW_NOT, KW_INC,
+    KW_DEC, KW_JMP, KW_BNE, KW_RED, KW_PRN, KW_JSR, KW_RTS, KW_STOP,
+    KW_R0, KW_R1, KW_R2, KW_R3, KW_R4, KW_R5, KW_R6, KW_R7,
+    KW_DATA, KW_STRING, KW_ENTRY, KW_EXTERN,
+    KW_MACR, KW_ENDMACR,
+    KW_COUNT
+};
+
+/* The single source of truth for every reserved word of the language.
+ * Opcode entries are stored at the index of their opcode value */
+static const Keyword keyword_table[KW_COUNT] = {
+        {"mov",  3, KEYWORD_OPCODE, 0,  2, SRC_ALL,     DST_WRITABLE},
+        {"cmp",  3, KEYWORD_OPCODE, 1,  2, SRC_ALL,     DST_ALL},
+        {"add",  3, KEYWORD_OPCODE, 2,  2, SRC_ALL,     DST_WRITABLE},
+        {"sub",  3, KEYWORD_OPCODE, 3,  2, SRC_ALL,     DST_WRITABLE},
+        {"lea",  3, KEYWORD_OPCODE, 4,  2, MODE_DIRECT, DST_WRITABLE},
+        {"clr",  3, KEYWORD_OPCODE, 5,  1, MODE_NONE,   DST_WRITABLE},
+        {"not",  3, KEYWORD_OPCODE, 6,  1, MODE_NONE,   DST_WRITABLE},
+        {"inc",  3, KEYWORD_OPCODE, 7,  1, MODE_NONE,   DST_WRITABLE},
+        {"dec",  3, KEYWORD_OPCODE, 8,  1, MODE_NONE,   DST_WRITABLE},
+        {"jmp",  3, KEYWORD_OPCODE, 9,  1, MODE_NONE,   DST_JUMP},
+        {"bne",  3, KEYWORD_OPCODE, 10, 1, MODE_NONE,   DST_JUMP},
+        {"red",  3, KEYWORD_OPCODE, 11, 1, MODE_NONE,   DST_WRITABLE},
+        {"prn",  3, KEYWORD_OPCODE, 12, 1, MODE_NONE,   DST_ALL},
+        {"jsr",  3, KEYWORD_OPCODE, 13, 1, MODE_NONE,   DST_JUMP},
+        {"rts",  3, KEYWORD_OPCODE, 14, 0, MODE_NONE,   MODE_NONE},
+        {"stop", 4, KEYWORD_OPCODE, 15, 0, MODE_NONE,   MODE_NONE},
+        {"r0", 2, KEYWORD_REGISTER, 0, 0, 0, 0},
+        {"r1", 2, KEYWORD_REGISTER, 1, 0, 0, 0},
+        {"r2", 2, KEYWORD_REGISTER, 2, 0, 0, 0},
+        {"r3", 2, KEYWORD_REGISTER, 3, 0, 0, 0},
+        {"r4", 2, KEYWORD_REGISTER, 4, 0, 0, 0},
+        {"r5", 2, KEYWORD_REGISTER, 5, 0, 0, 0},
+        {"r6", 2, KEYWORD_REGISTER, 6, 0, 0, 0},
+        {"r7", 2, KEYWORD_REGISTER, 7, 0, 0, 0},
+        {".data",   5, KEYWORD_DIRECTIVE, DIRECTIVE_DATA,   0, 0, 0},
+        {".string", 7, KEYWORD_DIRECTIVE, DIRECTIVE_STRING, 0, 0, 0},
+        {".entry",  6, KEYWORD_DIRECTIVE, DIRECTIVE_ENTRY,  0, 0, 0},
+        {".extern", 7, KEYWORD_DIRECTIVE, DIRECTIVE_EXTERN, 0, 0, 0},
+        {"macr",    4, KEYWORD_MACRO, MACRO_START, 0, 0, 0},
+        {"endmacr", 7, KEYWORD_MACRO, MACRO_END,   0, 0, 0}
+};
+
+/* Pick the only table entry a word could be, switching on its length and
+ * then on the characters that tell keywords of that length apart.
+ * A single comparison against the candidate then confirms the match */
+const Keyword* find_keyword(const char* word, size_t length) {
+    int candidate = -1;
+
+    switch (length) {
+        case 2:
+            if (word[0] == 'r' && word[1] >= '0' && word[1] <= '7') {
+                return &keyword_table[KW_R0 + (word[1] - '0')];
+            }
+            return NULL;
+        case 3:
+            switch (word[0]) {
+                case 'a': candidate = KW_ADD; break;
+                case 'b': candidate = KW_BNE; break;
+                case 'c': candidate = word[1] == 'm' ? KW_CMP : KW_CLR; break;
+                case 'd': candidate = KW_DEC; break;
+                case 'i': candidate = KW_INC; break;
+                case 'j': candidate = word[1] == 'm' ? KW_JMP : KW_JSR; break;
+                case 'l': candidate = KW_LEA; break;
+                case 'm': candidate = KW_MOV; break;
+                case 'n': candidate = KW_NOT; break;
+                case 'p': candidate = KW_PRN; break;
+                case 'r': candidate = word[1] == 'e' ? KW_RED : KW_RTS; break;
+                case 's': candidate = KW_SUB; break;
+                default: return NULL;
+            }
+            break;
+        case 4:
+            candidate = word[0] == 's' ? KW_STOP : KW_MACR;
+            break;
+        case 5:
+            candidate = KW_DATA;
+            break;
+        case 6:
+            candidate = KW_ENTRY;
+            break;
+        case 7:
+            if (word[0] == 'e') {
+                candidate = KW_ENDMACR;
+            } else {
+                candidate = word[1] == 's' ? KW_STRING : KW_EXTERN;
+            }
+            break;
+        default:
+            return NULL;
+    }
+
+    if (memcmp(keyword_table[candidate].name, word, length) != 0) {
+        return NULL;
+    }
+    return &keyword_table[candidate];
+}
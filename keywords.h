@@ -0,0 +1,59 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stddef.h>
+
+/* Enum to represent different addressing methods for operands */
+typedef enum {
+    ADDR_IMMEDIATE,  /* Immediate value, e.g., #5 */
+    ADDR_DIRECT,     /* Direct address or label */
+    ADDR_INDEX,      /* Index addressing, e.g., *r3 */
+    ADDR_REGISTER    /* Register addressing, e.g., r7 */
+} AddressingMethod;
+
+/* Bit masks for the legal addressing methods of an operand */
+#define MODE_IMMEDIATE (1 << ADDR_IMMEDIATE)
+#define MODE_DIRECT    (1 << ADDR_DIRECT)
+#define MODE_INDEX     (1 << ADDR_INDEX)
+#define MODE_REGISTER  (1 << ADDR_REGISTER)
+#define MODE_NONE      0
+#define MODE_ANY       (MODE_IMMEDIATE | MODE_DIRECT | MODE_INDEX | MODE_REGISTER)
+
+typedef enum {
+    KEYWORD_OPCODE,
+    KEYWORD_REGISTER,
+    KEYWORD_DIRECTIVE,
+    KEYWORD_MACRO
+} KeywordKind;
+
+typedef enum {
+    DIRECTIVE_DATA,
+    DIRECTIVE_STRING,
+    DIRECTIVE_ENTRY,
+    DIRECTIVE_EXTERN
+} DirectiveType;
+
+typedef enum {
+    MACRO_START,
+    MACRO_END
+} MacroKeywordType;
+
+/* A reserved word of the language.
+ * For opcodes, value is the opcode and the mode masks say which addressing
+ * methods each operand accepts. For registers it is the register number,
+ * for directives a DirectiveType and for macro keywords a MacroKeywordType */
+typedef struct {
+    const char* name;
+    unsigned char length;
+    unsigned char kind;
+    unsigned char value;
+    unsigned char operand_count;
+    unsigned char src_modes;
+    unsigned char dst_modes;
+} Keyword;
+
+/* Classify a word of the given length, returns NULL if it is not reserved.
+ * The word does not need to be null terminated */
+const Keyword* find_keyword(const char* word, size_t length);
+
+#endif /* KEYWORDS_H */
@@ -0,0 +1,194 @@
+#include "lexer.h"
+#include "scanner.h"
+#include "directives.h"
+
+/* Classes of single characters, tested where the lexer already knows the
+ * position. Bytes outside ASCII have none */
+#define CLASS_SPACE 1
+#define CLASS_ALPHA 2
+#define CLASS_DIGIT 4
+#define CLASS_ALNUM (CLASS_ALPHA | CLASS_DIGIT)
+
+static const unsigned char char_class[128] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0,
+        0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+        2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0,
+        0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+        2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0
+};
+
+#define IS(c, class) ((unsigned char)(c) < 128 && (char_class[(unsigned char)(c)] & (class)) != 0)
+
+/* What scan_next looks for */
+#define FIND_SPACE 0
+#define FIND_NON_SPACE 1
+#define FIND_NON_ALNUM 2
+#define FIND_SEPARATOR 3     /* Space or comma */
+
+/* Walks a line with the byte classes of one block at a time */
+typedef struct {
+    const char* text;
+    size_t length;
+    size_t block;            /* Offset of the block masks describes */
+    ScanMasks masks;
+} ScanCursor;
+
+static size_t scan_next(ScanCursor* cursor, size_t offset, int query);
+static size_t lex_operand(ScanCursor* cursor, size_t start, Operand* operand);
+static void lex_operands(ScanCursor* cursor, size_t offset, Statement* statement);
+
+/* Offset of the first byte at or after offset that answers the query, or
+ * the length of the line. Whole blocks are skipped with one mask test */
+static size_t scan_next(ScanCursor* cursor, size_t offset, int query) {
+    size_t block;
+    unsigned int mask;
+
+    while (offset < cursor->length) {
+        block = offset - offset % SCAN_BLOCK_SIZE;
+        if (block != cursor->block) {
+            scan_block(cursor->text + block, cursor->length - block, &cursor->masks);
+            cursor->block = block;
+        }
+
+        switch (query) {
+            case FIND_SPACE: mask = cursor->masks.space; break;
+            case FIND_NON_SPACE: mask = ~cursor->masks.space; break;
+            case FIND_NON_ALNUM: mask = ~cursor->masks.alnum; break;
+            default: mask = cursor->masks.space | cursor->masks.comma; break;
+        }
+        mask >>= offset - block;
+        if (mask != 0) {
+            /* Bytes past the end belong to no class, so a negated query
+             * can stop there */
+            offset += SCAN_FIRST_BIT(mask);
+            return offset < cursor->length ? offset : cursor->length;
+        }
+        offset = block + SCAN_BLOCK_SIZE;
+    }
+    return cursor->length;
+}
+
+/* Scan one operand up to the next comma, space or the end of the line and
+ * classify it by its first characters: #number, *rN, rN or a label.
+ * Returns the offset after the operand */
+static size_t lex_operand(ScanCursor* cursor, size_t start, Operand* operand) {
+    const char* text = cursor->text;
+    size_t end = scan_next(cursor, start, FIND_SEPARATOR);
+    size_t p = start + 1;
+    int negative = 0;
+
+    operand->text = text + start;
+    operand->length = end - start;
+    operand->value = 0;
+    operand->is_valid = 0;
+    operand->method = ADDR_DIRECT;
+    if (end == start) return end;
+
+    if (text[start] == '#') {
+        operand->method = ADDR_IMMEDIATE;
+        if (p < end && (text[p] == '-' || text[p] == '+')) negative = text[p++] == '-';
+        if (p < end) {
+            for (; p < end && IS(text[p], CLASS_DIGIT); p++) {
+                /* Too large for the operand word, kept above DATA_MAX for check_operands */
+                if (operand->value <= DATA_MAX + 1) operand->value = operand->value * 10 + (text[p] - '0');
+            }
+            operand->is_valid = p == end;
+            if (negative) operand->value = -operand->value;
+        }
+    } else if (text[start] == '*') {
+        operand->method = ADDR_INDEX;
+        if (end - start == 3 && text[start + 1] == 'r' && text[start + 2] >= '0' && text[start + 2] <= '7') {
+            operand->value = text[start + 2] - '0';
+            operand->is_valid = 1;
+        }
+    } else if (IS(text[start], CLASS_ALPHA)) {
+        operand->is_valid = scan_next(cursor, p, FIND_NON_ALNUM) >= end;
+        if (end - start == 2 && text[start] == 'r' && text[p] >= '0' && text[p] <= '7') {
+            operand->method = ADDR_REGISTER;
+            operand->value = text[p] - '0';
+        }
+    }
+    return end;
+}
+
+/* Scan a comma separated list of operands. An empty list has no operands,
+ * but an empty item between commas counts as an invalid operand */
+static void lex_operands(ScanCursor* cursor, size_t offset, Statement* statement) {
+    Operand extra;
+    Operand* operand;
+
+    offset = scan_next(cursor, offset, FIND_NON_SPACE);
+    if (offset == cursor->length) return;
+
+    for (;;) {
+        operand = statement->operand_count < MAX_OPERANDS ? &statement->operands[statement->operand_count] : &extra;
+        statement->operand_count++;
+        offset = scan_next(cursor, lex_operand(cursor, offset, operand), FIND_NON_SPACE);
+        if (!operand->is_valid) statement->malformed = 1;
+
+        if (offset == cursor->length) return;
+        if (cursor->text[offset] != ',') {
+            /* Two operands without a comma between them */
+            statement->malformed = 1;
+            return;
+        }
+        offset = scan_next(cursor, offset + 1, FIND_NON_SPACE);
+    }
+}
+
+void lex_line(const char* text, size_t length, Statement* statement) {
+    const char* end = text + length;
+    ScanCursor cursor;
+    size_t offset, word, word_end;
+
+    statement->kind = STATEMENT_EMPTY;
+    statement->label = NULL;
+    statement->label_length = 0;
+    statement->keyword = NULL;
+    statement->arguments = end;
+    statement->arguments_length = 0;
+    statement->operand_count = 0;
+    statement->malformed = 0;
+
+    cursor.text = text;
+    cursor.length = length;
+    cursor.block = (size_t)-1;
+
+    offset = scan_next(&cursor, 0, FIND_NON_SPACE);
+    statement->word = text + offset;
+    if (offset == length || text[offset] == ';') return;
+
+    /* A first word of letters and digits is either a label, when a colon
+     * follows it, or already the start of the opcode */
+    word = offset;
+    word_end = offset;
+    if (IS(text[offset], CLASS_ALPHA)) {
+        word_end = scan_next(&cursor, offset + 1, FIND_NON_ALNUM);
+        if (word_end < length && text[word_end] == ':') {
+            statement->label = text + word;
+            statement->label_length = word_end - word;
+            word = scan_next(&cursor, word_end + 1, FIND_NON_SPACE);
+            word_end = word;
+        }
+    }
+    word_end = scan_next(&cursor, word_end, FIND_SPACE);
+
+    statement->word = text + word;
+    statement->keyword = find_keyword(text + word, word_end - word);
+    if (statement->keyword == NULL) {
+        statement->kind = STATEMENT_UNKNOWN;
+    } else if (statement->keyword->kind == KEYWORD_DIRECTIVE) {
+        statement->kind = STATEMENT_DIRECTIVE;
+        statement->arguments = text + scan_next(&cursor, word_end, FIND_NON_SPACE);
+        while (end > statement->arguments && IS(end[-1], CLASS_SPACE)) end--;
+        statement->arguments_length = (size_t)(end - statement->arguments);
+    } else if (statement->keyword->kind == KEYWORD_OPCODE) {
+        statement->kind = STATEMENT_INSTRUCTION;
+        lex_operands(&cursor, word_end, statement);
+    } else {
+        statement->kind = STATEMENT_UNKNOWN;
+    }
+}
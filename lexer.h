@@ -0,0 +1,45 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include "keywords.h"
+
+/* Operands stored in a Statement, more are only counted */
+#define MAX_OPERANDS 2
+
+/* What a line holds once its label is taken off */
+typedef enum {
+    STATEMENT_EMPTY,        /* Blank or comment line */
+    STATEMENT_INSTRUCTION,  /* An opcode and its operands */
+    STATEMENT_DIRECTIVE,    /* A directive and its arguments */
+    STATEMENT_UNKNOWN       /* The first word is neither, or is missing */
+} StatementKind;
+
+/* An operand as a slice of the line, classified while it is scanned */
+typedef struct {
+    const char* text;
+    size_t length;
+    AddressingMethod method;
+    int value;              /* Immediate value or register number */
+    int is_valid;           /* The text has the form of its addressing method */
+} Operand;
+
+/* A line split into its tokens. All text points into the line */
+typedef struct {
+    StatementKind kind;
+    const char* label;      /* Label without the colon */
+    size_t label_length;    /* 0 if the line has no label */
+    const char* word;       /* Opcode or directive as written */
+    const Keyword* keyword; /* Opcode or directive, NULL if unknown */
+    const char* arguments;  /* Arguments of a directive, trimmed */
+    size_t arguments_length;
+    int operand_count;      /* Comma separated operands found */
+    int malformed;          /* An operand is invalid or a comma is missing */
+    Operand operands[MAX_OPERANDS];  /* In source order */
+} Statement;
+
+/* Split a line into a statement in one left to right scan.
+ * The line does not need to be null terminated */
+void lex_line(const char* text, size_t length, Statement* statement);
+
+#endif /* LEXER_H */
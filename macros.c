@@ -1,134 +1,1112 @@
 /* macros.c */
 
 #include "macros.h"
+#include "keywords.h"
+#include "operand_validation.h"
+#include "source_reader.h"
+#include "arena.h"
+#include "hash.h"
+#include "stats.h"
 #include <string.h>
+#include <stdlib.h>
 #include <ctype.h>
+#include <pthread.h>
 
-/* Array to store macros */
-Macro macros[MAX_MACROS];
-int macro_count = 0;
-
-/* Known words (used for macro name validation) */
-extern const char *group1[];
-extern const int group1_count;
-extern const char *group2[];
-extern const int group2_count;
-extern const char *group3[];
-extern const int group3_count;
-extern const char *instruction_words[];
-extern const int instruction_words_count;
-
-/* Function to check if a word is in a given list */
-int word_in_list(const char *word, const char *list[], int list_count) {
-    int i;
-    for (i = 0; i < list_count; i++) {
-        if (strcmp(word, list[i]) == 0) {
+/* A run of whole lines of the source, as file offsets */
+typedef struct {
+    size_t start;
+    size_t end;
+} LineRun;
+
+/* Lines that expansion leaves out: macro definitions and stray endmacr lines.
+ * The runs are in file order and do not touch */
+typedef struct {
+    LineRun *runs;
+    int count;
+    int capacity;
+} RemovedLines;
+
+/* A part of the source whose macro calls are expanded by one thread */
+typedef struct {
+    const MacroTable *table;      /* Complete, only read */
+    const SourceFile *source;
+    size_t start;                 /* File offsets of the lines of the chunk */
+    size_t end;
+    const LineRun *removed;       /* Removed lines from the start of the chunk on */
+    int removed_count;
+    ExpandedSource program;       /* Spans of the chunk, lines counted from its start */
+    MacroExpander expander;       /* Expansions of the chunk, in its own arena */
+    Diagnostics *diagnostics;     /* Shared by all chunks */
+    int first_line;               /* Lines before the chunk, -1 until an error needs it */
+    int failed;
+} ExpansionChunk;
+
+/* Function to check if a word can be a macro name */
+int can_be_macro_name(const char *word) {
+    /* Reserved words (opcodes, registers, directives, macr/endmacr) cannot be used */
+    return *word != '\0' && find_keyword(word, strlen(word)) == NULL;
+}
+
+/* Function to probe the index for a name, returns the slot holding it
+ * or the empty slot where it would go */
+static unsigned int find_macro_slot(const MacroTable *table, const char *name, size_t length, unsigned int hash) {
+    unsigned int i = hash & table->slot_mask;
+    const Macro *macro;
+
+    while (table->slots[i].macro >= 0) {
+        macro = &table->macros[table->slots[i].macro];
+        if (table->slots[i].hash == hash && macro->name_length == length &&
+            memcmp(name, macro->name, length) == 0) {
+            break;
+        }
+        i = (i + 1) & table->slot_mask;
+    }
+    return i;
+}
+
+/* Function to find a macro by name, returns its index or -1 */
+int find_macro(const MacroTable *table, const char *name, size_t length) {
+    if (table->count == 0) return -1;
+    return table->slots[find_macro_slot(table, name, length, hash_text(name, length))].macro;
+}
+
+/* Function to double the macro table and rebuild the index */
+static int grow_macros(MacroTable *table) {
+    int capacity = table->capacity ? table->capacity * 2 : 16;
+    unsigned int mask = (unsigned int)capacity * 2 - 1;
+    MacroSlot *slots;
+    Macro *grown;
+    unsigned int i, j;
+
+    grown = realloc(table->macros, capacity * sizeof(Macro));
+    if (grown == NULL) return 0;
+    table->macros = grown;
+
+    slots = malloc((mask + 1) * sizeof(MacroSlot));
+    if (slots == NULL) return 0;
+    for (i = 0; i <= mask; i++) {
+        slots[i].macro = -1;
+    }
+    for (i = 0; i < (unsigned int)table->count; i++) {
+        unsigned int hash = hash_text(table->macros[i].name, table->macros[i].name_length);
+        j = hash & mask;
+        while (slots[j].macro >= 0) j = (j + 1) & mask;
+        slots[j].hash = hash;
+        slots[j].macro = (int)i;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_mask = mask;
+    table->capacity = capacity;
+    return 1;
+}
+
+/* Function to add a macro whose name, parameters and body are already in the arena.
+ * A redefinition keeps the first body */
+static int add_macro(MacroTable *table, const char *name, size_t name_length, const char *content, size_t content_length,
+                     size_t defined_at, MacroWord *parameters, int parameter_count) {
+    unsigned int hash = hash_text(name, name_length);
+    unsigned int slot;
+    Macro *macro;
+
+    if (table->count == table->capacity && !grow_macros(table)) return 0;
+
+    slot = find_macro_slot(table, name, name_length, hash);
+    if (table->slots[slot].macro >= 0) return 1;
+
+    macro = &table->macros[table->count];
+    macro->name = name;
+    macro->name_length = name_length;
+    macro->content = content;
+    macro->content_length = content_length;
+    macro->defined_at = defined_at;
+    macro->parameters = parameters;
+    macro->parameter_count = parameter_count;
+    macro->calls_macros = 0;
+
+    table->slots[slot].hash = hash;
+    table->slots[slot].macro = table->count++;
+    return 1;
+}
+
+/* Function to append a line and its newline to the macro body being built */
+static char *append_macro_line(MacroTable *table, char *content, size_t *content_length, const LineView *line) {
+    content = arena_extend(&table->arena, content, *content_length, line->length + 1);
+    if (content == NULL) return NULL;
+
+    memcpy(content + *content_length, line->text, line->length);
+    content[*content_length + line->length] = '\n';
+    *content_length += line->length + 1;
+    return content;
+}
+
+void init_macro_table(MacroTable *table) {
+    table->macros = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->slots = NULL;
+    table->slot_mask = 0;
+    arena_init(&table->arena);
+    table->collect_seconds = 0;
+}
+
+/* Function to remove all macros but keep the table, index and arena memory */
+void clear_macro_table(MacroTable *table) {
+    unsigned int i, j;
+
+    /* Empty only the slots in use, see clear_symbol_table */
+    for (i = 0; i < (unsigned int)table->count; i++) {
+        j = hash_text(table->macros[i].name, table->macros[i].name_length) & table->slot_mask;
+        while (table->slots[j].macro != (int)i) j = (j + 1) & table->slot_mask;
+        table->slots[j].macro = -1;
+    }
+    table->count = 0;
+    arena_reset(&table->arena);
+}
+
+void free_macro_table(MacroTable *table) {
+    arena_free(&table->arena);
+    free(table->macros);
+    free(table->slots);
+    init_macro_table(table);
+}
+
+/* Function to append a span, growing the span list geometrically */
+static int add_span(ExpandedSource *program, const char *text, size_t length,
+                    int line_number, size_t offset, int macro) {
+    SourceSpan *span;
+
+    if (length == 0) return 1;
+
+    if (program->count == program->capacity) {
+        int capacity = program->capacity ? program->capacity * 2 : 64;
+        SourceSpan *grown = realloc(program->spans, capacity * sizeof(SourceSpan));
+        if (grown == NULL) return 0;
+        program->spans = grown;
+        program->capacity = capacity;
+    }
+
+    span = &program->spans[program->count++];
+    span->text = text;
+    span->length = length;
+    span->line_number = line_number;
+    span->offset = offset;
+    span->macro = macro;
+    return 1;
+}
+
+/* Function to find the first place of a piece of text in a buffer, or NULL */
+static const char *find_text(const char *data, size_t size, const char *text, size_t length) {
+    const char *end = data + size;
+    const char *found;
+
+    while ((size_t)(end - data) >= length) {
+        found = memchr(data, text[0], (size_t)(end - data) - length + 1);
+        if (found == NULL) return NULL;
+        if (memcmp(found, text, length) == 0) return found;
+        data = found + 1;
+    }
+    return NULL;
+}
+
+/* Function to count the newlines of a buffer */
+static size_t count_newlines(const char *data, size_t size) {
+    const char *end = data + size;
+    size_t count = 0;
+
+    if (size == 0) return 0;
+    while ((data = memchr(data, '\n', (size_t)(end - data))) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+/* Function to check if a buffer contains a piece of text anywhere */
+static int contains_text(const char *data, size_t size, const char *text, size_t length) {
+    return find_text(data, size, text, length) != NULL;
+}
+
+/* Function to count the lines of a buffer, a last line without a newline included */
+static int count_lines(const char *data, size_t size) {
+    int count = (int)count_newlines(data, size);
+    return size > 0 && data[size - 1] != '\n' ? count + 1 : count;
+}
+
+/* Function to get the first word of a line and the keyword it is, if any */
+static const Keyword *first_word_of(const LineView *line, const char **word, size_t *length) {
+    const char *end = line->text + line->length;
+    const char *first_word = line->text;
+
+    while (first_word < end && isspace((unsigned char)*first_word)) first_word++;
+    *word = first_word;
+    *length = word_length(first_word, end);
+    return find_keyword(first_word, *length);
+}
+
+/* Function to build a macro body from the lines of the source between start and end */
+static int append_macro_lines(MacroTable *table, const SourceFile *source, size_t start, size_t end,
+                              char **content, size_t *content_length) {
+    SourceFile reader = *source;
+    LineView line;
+
+    reader.position = start;
+    reader.size = end;
+    *content = NULL;
+    *content_length = 0;
+    while (source_next_line(&reader, &line)) {
+        *content = append_macro_line(table, *content, content_length, &line);
+        if (*content == NULL) return 0;
+    }
+    return 1;
+}
+
+/* Function to split a list of words separated by commas, with the spaces
+ * around the words left out. Stores at most limit words.
+ * Returns the number of words, or -1 if one of them is empty */
+static int split_words(const char *text, size_t length, MacroWord *words, int limit) {
+    const char *end = text + length;
+    const char *start, *last, *comma;
+    int count = 0;
+
+    while (text < end && isspace((unsigned char)*text)) text++;
+    if (text == end) return 0;
+
+    for (;;) {
+        comma = memchr(text, ',', (size_t)(end - text));
+        start = text;
+        last = comma != NULL ? comma : end;
+        while (start < last && isspace((unsigned char)*start)) start++;
+        while (last > start && isspace((unsigned char)last[-1])) last--;
+        if (start == last) return -1;
+
+        if (count < limit) {
+            words[count].text = start;
+            words[count].length = (size_t)(last - start);
+        }
+        count++;
+        if (comma == NULL) return count;
+        text = comma + 1;
+    }
+}
+
+/* Function to read the parameter names that follow the macro name on a macr
+ * line into the arena. A name must be able to name a symbol and appear once.
+ * Reports the names that cannot be used. Returns 0 if out of memory */
+static int read_parameters(MacroTable *table, Diagnostics *diagnostics, const LineView *line, const char *text,
+                           const char *macro_name, MacroWord **parameters, int *parameter_count) {
+    MacroWord words[MAX_MACRO_PARAMETERS];
+    const char *word;
+    int count = split_words(text, (size_t)(line->text + line->length - text), words, MAX_MACRO_PARAMETERS);
+    int i, j, valid;
+
+    *parameters = NULL;
+    *parameter_count = 0;
+    if (count < 0) {
+        report_error(diagnostics, line->line_number, "Missing parameter name in the definition of macro '%s'",
+                     macro_name);
+        return 1;
+    }
+    if (count > MAX_MACRO_PARAMETERS) {
+        report_error(diagnostics, line->line_number, "Macro '%s' has more than %d parameters", macro_name,
+                     MAX_MACRO_PARAMETERS);
+        return 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        word = words[i].text;
+        valid = isalpha((unsigned char)word[0]) && find_keyword(word, words[i].length) == NULL;
+        for (j = 1; valid && j < (int)words[i].length; j++) {
+            valid = isalnum((unsigned char)word[j]);
+        }
+        for (j = 0; valid && j < i; j++) {
+            valid = words[j].length != words[i].length || memcmp(words[j].text, word, words[i].length) != 0;
+        }
+        if (!valid) {
+            report_error(diagnostics, line->line_number, "Invalid parameter name '%.*s' of macro '%s'",
+                         (int)words[i].length, word, macro_name);
             return 1;
         }
     }
-    return 0;
+    if (count == 0) return 1;
+
+    *parameters = arena_alloc(&table->arena, (size_t)count * sizeof(MacroWord));
+    if (*parameters == NULL) return 0;
+    for (i = 0; i < count; i++) {
+        (*parameters)[i].text = arena_strndup(&table->arena, words[i].text, words[i].length);
+        if ((*parameters)[i].text == NULL) return 0;
+        (*parameters)[i].length = words[i].length;
+    }
+    *parameter_count = count;
+    return 1;
 }
 
-/* Function to check if a word can be a macro name */
-int can_be_macro_name(const char *word) {
-    /* Check if the word is a known word */
-    if (word_in_list(word, group1, group1_count) ||
-        word_in_list(word, group2, group2_count) ||
-        word_in_list(word, group3, group3_count) ||
-        word_in_list(word, instruction_words, instruction_words_count)) {
-        return 0;
+/* Function to record a removed run of lines, joining it to the previous one when they touch */
+static int add_removed(RemovedLines *removed, size_t start, size_t end) {
+    if (removed->count > 0 && removed->runs[removed->count - 1].end == start) {
+        removed->runs[removed->count - 1].end = end;
+        return 1;
     }
-    /* Any name that is not a known word is considered valid */
+    if (removed->count == removed->capacity) {
+        int capacity = removed->capacity ? removed->capacity * 2 : 16;
+        LineRun *grown = realloc(removed->runs, capacity * sizeof(LineRun));
+        if (grown == NULL) return 0;
+        removed->runs = grown;
+        removed->capacity = capacity;
+    }
+    removed->runs[removed->count].start = start;
+    removed->runs[removed->count].end = end;
+    removed->count++;
     return 1;
 }
 
-/* Function to handle lines inside a macro */
-void handle_macro_inside(const char *macro_name, FILE *file) {
-    char line[256];
-    Macro macro;
-    strncpy(macro.name, macro_name, sizeof(macro.name));
-    macro.name[sizeof(macro.name) - 1] = '\0';
-    macro.content[0] = '\0'; /* Initialize content to empty */
+/* First phase of expansion: find every macr ... endmacr block, check the
+ * names and store the bodies. Only lines that contain "macr" are looked at,
+ * the lines in between are skipped with a text search. The lines that do not
+ * make it to the expanded program are recorded in removed.
+ * Returns 0 if out of memory */
+static int collect_macros(MacroTable *table, Diagnostics *diagnostics, const SourceFile *source,
+                          RemovedLines *removed) {
+    SourceFile reader = *source;
+    LineView line;
+    const char *data = source->data;
+    const char *found;
+    const char *first_word;
+    size_t first_word_length;
+    const Keyword *keyword;
+    char *macro_name = NULL;
+    size_t name_length = 0;
+    MacroWord *parameters = NULL;
+    int parameter_count = 0;
+    char *content;
+    size_t content_length;
+    size_t body_start = 0;     /* File offset of the first line of the body being defined */
+    size_t removed_start = 0;  /* File offset where the lines of the definition start */
+    int in_macro_definition = 0;
+    int name_rejected = 0;     /* The macro being defined is reported and not added */
+    int definition_line = 0;   /* Line of the macr of the macro being defined */
+    size_t start;
+
+    reader.position = 0;
+    reader.line_number = 0;
+
+    while ((found = find_text(data + reader.position, source->size - reader.position, "macr", 4)) != NULL) {
+        /* Go back to the start of the line the text is on */
+        start = (size_t)(found - data);
+        while (start > reader.position && data[start - 1] != '\n') start--;
+        reader.line_number += (int)count_newlines(data + reader.position, start - reader.position);
+        reader.position = start;
 
-    while (fgets(line, sizeof(line), file)) {
-        /* Remove trailing newline and carriage return characters */
-        line[strcspn(line, "\r\n")] = 0;
+        source_next_line(&reader, &line);
+        keyword = first_word_of(&line, &first_word, &first_word_length);
+        if (keyword == NULL || keyword->kind != KEYWORD_MACRO) continue;
 
-        /* Check for the end of macro definition */
-        if (strcmp(line, "endmacro") == 0) {
-            /* Save the macro */
-            if (macro_count < MAX_MACROS) {
-                macros[macro_count++] = macro;
+        if (keyword->value == MACRO_START) {
+            const char *name = first_word + first_word_length;
+            const char *end = line.text + line.length;
+
+            while (name < end && isspace((unsigned char)*name)) name++;
+            name_length = word_length(name, end);
+            macro_name = arena_strndup(&table->arena, name, name_length);
+            if (macro_name == NULL) return 0;
+
+            name_rejected = 1;
+            if (!can_be_macro_name(macro_name)) {
+                report_error(diagnostics, line.line_number, "Invalid macro name '%s'", macro_name);
+            } else if (find_macro(table, macro_name, name_length) >= 0) {
+                report_error(diagnostics, line.line_number, "Macro '%s' is already defined", macro_name);
+            } else {
+                name_rejected = 0;
+            }
+            if (!read_parameters(table, diagnostics, &line, name + name_length, macro_name, &parameters,
+                                 &parameter_count)) {
+                return 0;
+            }
+            /* A macr line inside a definition starts over with a new macro */
+            if (!in_macro_definition) removed_start = line.offset;
+            in_macro_definition = 1;
+            definition_line = line.line_number;
+            body_start = reader.position;
+        } else {
+            if (in_macro_definition && !name_rejected) {
+                /* Add the macro to the macros table */
+                if (!append_macro_lines(table, source, body_start, line.offset, &content, &content_length) ||
+                    !add_macro(table, macro_name, name_length, content, content_length, reader.position, parameters,
+                               parameter_count)) {
+                    return 0;
+                }
+            } else if (!in_macro_definition) {
+                removed_start = line.offset;
             }
-            return;
+            in_macro_definition = 0;
+            if (!add_removed(removed, removed_start, reader.position)) return 0;
         }
-        /* Append line to the macro content */
-        strncat(macro.content, line, sizeof(macro.content) - strlen(macro.content) - 1);
-        strncat(macro.content, "\n", sizeof(macro.content) - strlen(macro.content) - 1);
     }
+
+    /* A definition without endmacr is an error, the rest of the file is
+     * left out so that it is not reported line by line */
+    if (in_macro_definition) {
+        report_error(diagnostics, definition_line, "Macro '%s' has no endmacr", macro_name);
+        if (!add_removed(removed, removed_start, source->size)) return 0;
+    }
+    return 1;
 }
 
-void replace_macros(const char *input_name, const char *output_name) {
-    FILE *input_file = fopen(input_name, "r");
-    FILE *output_file = fopen(output_name, "w");
-    char line[256];
-    int in_macro_definition = 0;
-    char macro_name[256] = {0};
-    char macro_content[1000] = {0};  /* Temporary storage for macro content*/
-    char first_word[256];
-    int is_macro = 0;
-    int i = 0;
+/* Function to note which macros have a body line that starts with the name
+ * of a macro. Calls of the other macros without arguments expand to their body */
+static void find_nested_calls(MacroTable *table) {
+    SourceFile body;
+    LineView line;
+    const char *first_word;
+    size_t first_word_length;
+    int i;
+
+    for (i = 0; i < table->count; i++) {
+        source_from_buffer(&body, table->macros[i].content, table->macros[i].content_length);
+        while (!table->macros[i].calls_macros && source_next_line(&body, &line)) {
+            first_word_of(&line, &first_word, &first_word_length);
+            table->macros[i].calls_macros = find_macro(table, first_word, first_word_length) >= 0;
+        }
+    }
+}
+
+void init_macro_expander(MacroExpander *expander, const MacroTable *table) {
+    int i;
 
-    if (input_file == NULL || output_file == NULL) {
-        return;
+    expander->table = table;
+    expander->expansions = NULL;
+    expander->count = 0;
+    expander->capacity = 0;
+    expander->slots = NULL;
+    expander->slot_mask = 0;
+    for (i = 0; i < MAX_MACRO_DEPTH; i++) {
+        expander->buffers[i] = NULL;
+        expander->buffer_capacities[i] = 0;
     }
+    expander->depth = 0;
+    arena_init(&expander->arena);
+}
 
-    while (fgets(line, sizeof(line), input_file)) {
-        line[strcspn(line, "\n")] = 0; /* Remove newline*/
+/* Function to forget all expansions, e.g. when the macro table changes */
+void clear_macro_expander(MacroExpander *expander) {
+    unsigned int i;
 
-        sscanf(line, "%s", first_word);
+    for (i = 0; expander->count > 0 && i <= expander->slot_mask; i++) {
+        expander->slots[i].macro = -1;
+    }
+    expander->count = 0;
+    arena_reset(&expander->arena);
+}
 
-        if (strcmp(first_word, "macr") == 0) {
-            in_macro_definition = 1;
-            sscanf(line, "%*s %s", macro_name);
-            macro_content[0] = '\0';  /* Reset macro content*/
+void free_macro_expander(MacroExpander *expander) {
+    int i;
+
+    for (i = 0; i < MAX_MACRO_DEPTH; i++) {
+        free(expander->buffers[i]);
+    }
+    free(expander->expansions);
+    free(expander->slots);
+    arena_free(&expander->arena);
+    init_macro_expander(expander, expander->table);
+}
+
+static unsigned int expansion_hash(int macro, const char *arguments, size_t length) {
+    return hash_text(arguments, length) ^ (unsigned int)macro * 2654435761u;
+}
+
+/* Function to probe the index for an expansion, see find_macro_slot */
+static unsigned int find_expansion_slot(const MacroExpander *expander, int macro, const char *arguments,
+                                        size_t length, unsigned int hash) {
+    unsigned int i = hash & expander->slot_mask;
+    const MacroExpansion *expansion;
+
+    while (expander->slots[i].macro >= 0) {
+        expansion = &expander->expansions[expander->slots[i].macro];
+        if (expander->slots[i].hash == hash && expansion->macro == macro &&
+            expansion->arguments_length == length &&
+            (length == 0 || memcmp(expansion->arguments, arguments, length) == 0)) {
+            break;
+        }
+        i = (i + 1) & expander->slot_mask;
+    }
+    return i;
+}
+
+/* Function to double the expansions and rebuild their index */
+static int grow_expansions(MacroExpander *expander) {
+    int capacity = expander->capacity ? expander->capacity * 2 : 64;
+    unsigned int mask = (unsigned int)capacity * 2 - 1;
+    const MacroExpansion *expansion;
+    MacroExpansion *grown;
+    MacroSlot *slots;
+    unsigned int i, j, hash;
+
+    grown = realloc(expander->expansions, capacity * sizeof(MacroExpansion));
+    if (grown == NULL) return 0;
+    expander->expansions = grown;
+
+    slots = malloc((mask + 1) * sizeof(MacroSlot));
+    if (slots == NULL) return 0;
+    for (i = 0; i <= mask; i++) {
+        slots[i].macro = -1;
+    }
+    for (i = 0; i < (unsigned int)expander->count; i++) {
+        expansion = &expander->expansions[i];
+        hash = expansion_hash(expansion->macro, expansion->arguments, expansion->arguments_length);
+        j = hash & mask;
+        while (slots[j].macro >= 0) j = (j + 1) & mask;
+        slots[j].hash = hash;
+        slots[j].macro = (int)i;
+    }
+
+    free(expander->slots);
+    expander->slots = slots;
+    expander->slot_mask = mask;
+    expander->capacity = capacity;
+    return 1;
+}
+
+/* Function to append text to the buffer of a level, growing it geometrically */
+static int append_text(MacroExpander *expander, int level, size_t *used, const char *text, size_t length) {
+    size_t capacity = expander->buffer_capacities[level];
+    char *grown;
+
+    if (*used + length > capacity) {
+        if (capacity == 0) capacity = 256;
+        while (capacity < *used + length) capacity *= 2;
+        grown = realloc(expander->buffers[level], capacity);
+        if (grown == NULL) return 0;
+        expander->buffers[level] = grown;
+        expander->buffer_capacities[level] = capacity;
+    }
+    if (length > 0) memcpy(expander->buffers[level] + *used, text, length);
+    *used += length;
+    return 1;
+}
+
+/* Function to append a body line with every word that names a parameter
+ * replaced by its argument. Quoted text, as in a .string, is kept as is */
+static int append_substituted(MacroExpander *expander, int level, size_t *used, const LineView *line,
+                              const Macro *macro, const MacroWord *arguments) {
+    const char *text = line->text;
+    const char *end = text + line->length;
+    const char *copied = text;
+    const char *word;
+    size_t length;
+    int i;
+
+    while (text < end) {
+        if (*text == '"') {
+            /* Skip to the closing quote, or the end of an unterminated string */
+            text++;
+            while (text < end && *text != '"') text++;
+            if (text < end) text++;
+            continue;
+        }
+        if (!isalnum((unsigned char)*text)) {
+            text++;
             continue;
         }
+        word = text;
+        while (text < end && isalnum((unsigned char)*text)) text++;
+        length = (size_t)(text - word);
 
-        if (strcmp(line, "endmacr") == 0) {
-            if (in_macro_definition) {
-                /* Add the macro to the macros array*/
-                if (macro_count < MAX_MACROS) {
-                    strncpy(macros[macro_count].name, macro_name, sizeof(macros[macro_count].name) - 1);
-                    strncpy(macros[macro_count].content, macro_content, sizeof(macros[macro_count].content) - 1);
-                    macro_count++;
+        for (i = 0; i < macro->parameter_count; i++) {
+            if (macro->parameters[i].length == length && memcmp(macro->parameters[i].text, word, length) == 0) {
+                if (!append_text(expander, level, used, copied, (size_t)(word - copied)) ||
+                    !append_text(expander, level, used, arguments[i].text, arguments[i].length)) {
+                    return 0;
                 }
+                copied = text;
+                break;
             }
-            in_macro_definition = 0;
-            macro_name[0] = '\0';
+        }
+    }
+    return append_text(expander, level, used, copied, (size_t)(end - copied));
+}
+
+/* Function to expand a call at the current depth of the expander, or find
+ * its expansion among the earlier ones. The body is built in the buffer of
+ * the depth, the nested calls in the buffers after it. Errors are reported
+ * on the line of the outermost call. Sets result to the expansion */
+static int expand_call(MacroExpander *expander, int macro, const char *arguments, size_t length, size_t limit,
+                       Diagnostics *diagnostics, int line_number, int *result) {
+    const MacroTable *table = expander->table;
+    const Macro *called = &table->macros[macro];
+    const MacroExpansion *inner;
+    MacroExpansion *expansion;
+    MacroWord words[MAX_MACRO_PARAMETERS];
+    SourceFile body;
+    LineView line;
+    const char *word;
+    const char *end;
+    const char *key;
+    char *text;
+    size_t used = 0, key_length, start, word_size;
+    size_t valid_from = called->defined_at, valid_until = (size_t)-1, defined_at;
+    int level = expander->depth;
+    int depth = 1;
+    int status = MACRO_EXPANDED;
+    int count, nested, index;
+    unsigned int hash, slot;
+    int i;
+
+    count = split_words(arguments, length, words, MAX_MACRO_PARAMETERS);
+    if (count < 0) {
+        if (diagnostics != NULL) {
+            report_error(diagnostics, line_number, "Missing argument in a call of macro '%s'", called->name);
+        }
+        return MACRO_ERROR;
+    }
+    if (count != called->parameter_count) {
+        if (diagnostics != NULL) {
+            report_error(diagnostics, line_number, "Wrong number of arguments for macro '%s': %d expected, %d given",
+                         called->name, called->parameter_count, count);
+        }
+        return MACRO_ERROR;
+    }
+    if (level == MAX_MACRO_DEPTH) {
+        if (diagnostics != NULL) {
+            report_error(diagnostics, line_number, "Macro calls are nested more than %d deep", MAX_MACRO_DEPTH);
+        }
+        return MACRO_ERROR;
+    }
+
+    /* The same arguments give the same text, as long as the same nested
+     * macros are defined */
+    for (i = 0; i < count; i++) {
+        if ((i > 0 && !append_text(expander, level, &used, ",", 1)) ||
+            !append_text(expander, level, &used, words[i].text, words[i].length)) {
+            return MACRO_NO_MEMORY;
+        }
+    }
+    hash = expansion_hash(macro, expander->buffers[level], used);
+    slot = 0;
+    if (expander->count > 0) {
+        slot = find_expansion_slot(expander, macro, expander->buffers[level], used, hash);
+        index = expander->slots[slot].macro;
+        if (index >= 0) {
+            inner = &expander->expansions[index];
+            if (inner->valid_from <= limit && limit < inner->valid_until && level + inner->depth <= MAX_MACRO_DEPTH) {
+                *result = index;
+                return MACRO_EXPANDED;
+            }
+        }
+    }
+
+    for (i = 0; i < level; i++) {
+        if (expander->active[i] == macro) {
+            if (diagnostics != NULL) {
+                report_error(diagnostics, line_number, "Macro '%s' is called within its own expansion",
+                             called->name);
+            }
+            return MACRO_ERROR;
+        }
+    }
+
+    key_length = used;
+    key = arena_strndup(&expander->arena, used > 0 ? expander->buffers[level] : "", key_length);
+    if (key == NULL) return MACRO_NO_MEMORY;
+
+    /* Expand the body line by line. Arguments of nested calls point into
+     * the buffer of this level, which does not change until they return */
+    expander->active[expander->depth++] = macro;
+    used = 0;
+    source_from_buffer(&body, called->content, called->content_length);
+    while (status == MACRO_EXPANDED && source_next_line(&body, &line)) {
+        start = used;
+        if (!append_substituted(expander, level, &used, &line, called, words)) {
+            status = MACRO_NO_MEMORY;
+            break;
+        }
+
+        word = expander->buffers[level] + start;
+        end = expander->buffers[level] + used;
+        while (word < end && isspace((unsigned char)*word)) word++;
+        word_size = word_length(word, end);
+        nested = find_macro(table, word, word_size);
+        if (nested >= 0) {
+            defined_at = table->macros[nested].defined_at;
+            if (defined_at > limit) {
+                if (defined_at < valid_until) valid_until = defined_at;
+                nested = -1;
+            } else if (defined_at > valid_from) {
+                valid_from = defined_at;
+            }
+        }
+        if (nested < 0) {
+            if (!append_text(expander, level, &used, "\n", 1)) status = MACRO_NO_MEMORY;
             continue;
         }
 
-        if (in_macro_definition) {
-            strncat(macro_content, line, sizeof(macro_content) - strlen(macro_content) - 1);
-            strncat(macro_content, "\n", sizeof(macro_content) - strlen(macro_content) - 1);
-        } else {
-            /* Check if line starts with a macro name and replace if necessary*/
+        status = expand_call(expander, nested, word + word_size, (size_t)(end - word - word_size), limit,
+                             diagnostics, line_number, &index);
+        if (status != MACRO_EXPANDED) break;
 
-            for (i = 0; i < macro_count; i++) {
-                if (strcmp(first_word, macros[i].name) == 0) {
-                    fputs(macros[i].content, output_file);
-                    is_macro = 1;
-                    break;
-                }
+        inner = &expander->expansions[index];
+        if (inner->valid_from > valid_from) valid_from = inner->valid_from;
+        if (inner->valid_until < valid_until) valid_until = inner->valid_until;
+        if (inner->depth + 1 > depth) depth = inner->depth + 1;
+        used = start;
+        if (!append_text(expander, level, &used, inner->text, inner->length)) status = MACRO_NO_MEMORY;
+    }
+    expander->depth--;
+    if (status != MACRO_EXPANDED) return status;
+
+    text = arena_alloc(&expander->arena, used > 0 ? used : 1);
+    if (text == NULL) return MACRO_NO_MEMORY;
+    if (used > 0) memcpy(text, expander->buffers[level], used);
+
+    /* A stale expansion of the same call is replaced */
+    if (expander->count > 0) slot = find_expansion_slot(expander, macro, key, key_length, hash);
+    if (expander->count == 0 || expander->slots[slot].macro < 0) {
+        if (expander->count == expander->capacity) {
+            if (!grow_expansions(expander)) return MACRO_NO_MEMORY;
+        }
+        slot = find_expansion_slot(expander, macro, key, key_length, hash);
+        expander->slots[slot].hash = hash;
+        expander->slots[slot].macro = expander->count++;
+    }
+
+    index = expander->slots[slot].macro;
+    expansion = &expander->expansions[index];
+    expansion->macro = macro;
+    expansion->arguments = key;
+    expansion->arguments_length = key_length;
+    expansion->text = text;
+    expansion->length = used;
+    expansion->depth = depth;
+    expansion->valid_from = valid_from;
+    expansion->valid_until = valid_until;
+    *result = index;
+    return MACRO_EXPANDED;
+}
+
+/* Function to expand a call of a macro with the arguments that follow its
+ * name. Nested calls expand macros whose definition ends at or before limit.
+ * Errors are reported on line_number, unless diagnostics is NULL.
+ * Returns MACRO_EXPANDED and sets text to the expansion, which stays valid
+ * until the expander is cleared, or MACRO_ERROR or MACRO_NO_MEMORY */
+int expand_macro_call(MacroExpander *expander, int macro, const char *arguments, size_t length, size_t limit,
+                      Diagnostics *diagnostics, int line_number, const char **text, size_t *text_length) {
+    const Macro *called = &expander->table->macros[macro];
+    const char *end = arguments + length;
+    int status, index;
+
+    *text = NULL;
+    *text_length = 0;
+
+    /* Most macros have nothing to substitute, their body is the expansion */
+    while (arguments < end && isspace((unsigned char)*arguments)) arguments++;
+    if (called->parameter_count == 0 && !called->calls_macros && arguments == end) {
+        *text = called->content;
+        *text_length = called->content_length;
+        return MACRO_EXPANDED;
+    }
+
+    expander->depth = 0;
+    status = expand_call(expander, macro, arguments, (size_t)(end - arguments), limit, diagnostics, line_number,
+                         &index);
+    if (status == MACRO_EXPANDED) {
+        *text = expander->expansions[index].text;
+        *text_length = expander->expansions[index].length;
+    }
+    return status;
+}
+
+/* Second phase of expansion, for the lines from start to end. Line numbers
+ * of the spans count from the start of the chunk. Returns 0 if out of memory */
+static int expand_lines(ExpansionChunk *chunk) {
+    const MacroTable *table = chunk->table;
+    const LineRun *run = chunk->removed;
+    const LineRun *last_run = chunk->removed + chunk->removed_count;
+    SourceFile reader = *chunk->source;
+    LineView line;
+    const char *data = reader.data;
+    const char *first_word;
+    const char *arguments;
+    const char *text;
+    size_t first_word_length;
+    size_t length;
+    size_t run_start = chunk->start;     /* File offset where the current run of source lines started */
+    int run_line = 1;
+    int called_macro;
+    int status;
+
+    reader.position = chunk->start;
+    reader.size = chunk->end;
+    reader.line_number = 0;
+
+    for (;;) {
+        /* Lines of macro definitions end the current run and are skipped */
+        if (run < last_run && reader.position == run->start) {
+            if (!add_span(&chunk->program, data + run_start, run->start - run_start, run_line, run_start, -1)) {
+                return 0;
             }
-            if (!is_macro) {
-                fputs(line, output_file);
-                fputc('\n', output_file);
+            while (reader.position < run->end && source_next_line(&reader, &line)) continue;
+            run_start = reader.position;
+            run_line = reader.line_number + 1;
+            run++;
+            continue;
+        }
+        if (!source_next_line(&reader, &line)) break;
+
+        /* Check if line starts with a macro that is defined by now,
+         * if not it stays in the current run */
+        first_word_of(&line, &first_word, &first_word_length);
+        called_macro = find_macro(table, first_word, first_word_length);
+        if (called_macro < 0 || table->macros[called_macro].defined_at > line.offset) continue;
+
+        /* A call with an error expands to nothing. Errors are rare, so the
+         * line number in the file is only worked out to report one */
+        arguments = first_word + first_word_length;
+        status = expand_macro_call(&chunk->expander, called_macro, arguments,
+                                   (size_t)(line.text + line.length - arguments), line.offset, NULL, 0, &text,
+                                   &length);
+        if (status == MACRO_ERROR) {
+            if (chunk->first_line < 0) chunk->first_line = (int)count_newlines(data, chunk->start);
+            status = expand_macro_call(&chunk->expander, called_macro, arguments,
+                                       (size_t)(line.text + line.length - arguments), line.offset, chunk->diagnostics,
+                                       chunk->first_line + line.line_number, &text, &length);
+        }
+        if (status == MACRO_NO_MEMORY) return 0;
+
+        if (!add_span(&chunk->program, data + run_start, line.offset - run_start, run_line, run_start, -1) ||
+            !add_span(&chunk->program, text, length, line.line_number, line.offset, called_macro)) {
+            return 0;
+        }
+        run_start = reader.position;
+        run_line = line.line_number + 1;
+    }
+
+    chunk->program.line_count = reader.line_number;
+    return add_span(&chunk->program, data + run_start, chunk->end - run_start, run_line, run_start, -1);
+}
+
+static void *expand_chunk(void *argument) {
+    ExpansionChunk *chunk = argument;
+
+    chunk->failed = !expand_lines(chunk);
+    return NULL;
+}
+
+/* Function to cut the source into at most chunk_count chunks of about the
+ * same size. A chunk ends after a newline and never inside a macro definition.
+ * Returns the number of chunks */
+static int split_source(const SourceFile *source, const RemovedLines *removed, ExpansionChunk *chunks,
+                        int chunk_count) {
+    const char *newline;
+    size_t start = 0, end, target;
+    int run = 0;
+    int count = 0;
+    int i;
+
+    for (i = 0; i < chunk_count && start < source->size; i++) {
+        end = source->size;
+        if (i < chunk_count - 1) {
+            target = source->size / (size_t)chunk_count * (size_t)(i + 1);
+            if (target <= start) continue;
+
+            newline = memchr(source->data + target, '\n', source->size - target);
+            if (newline != NULL) end = (size_t)(newline + 1 - source->data);
+            while (run < removed->count && removed->runs[run].end <= end) run++;
+            if (run < removed->count && removed->runs[run].start < end) end = removed->runs[run].end;
+        }
+
+        chunks[count].start = start;
+        chunks[count].end = end;
+        start = end;
+        count++;
+    }
+    return count;
+}
+
+/* Function to expand the calls of up to chunk_count chunks of the source
+ * at the same time and join the spans of the chunks in order. The
+ * expansions end up in the arena of the table, calls with errors are
+ * reported by every chunk as it finds them. Returns 0 if out of memory */
+static int expand_chunks(MacroTable *table, Diagnostics *diagnostics, const SourceFile *source,
+                         const RemovedLines *removed, ExpandedSource *program, int chunk_count) {
+    ExpansionChunk *chunks;
+    pthread_t *threads;
+    const SourceSpan *span;
+    SourceSpan *last;
+    int *started;
+    int line_base = 0;
+    int ok;
+    int i, j;
+
+    program->count = 0;
+    program->line_count = 0;
+
+    chunks = calloc((size_t)chunk_count, sizeof(ExpansionChunk));
+    threads = malloc((size_t)chunk_count * sizeof(pthread_t));
+    started = calloc((size_t)chunk_count, sizeof(int));
+    ok = chunks != NULL && threads != NULL && started != NULL;
+
+    if (ok) {
+        chunk_count = split_source(source, removed, chunks, chunk_count);
+        for (i = 0, j = 0; i < chunk_count; i++) {
+            chunks[i].table = table;
+            chunks[i].source = source;
+            chunks[i].diagnostics = diagnostics;
+            chunks[i].first_line = -1;
+            init_macro_expander(&chunks[i].expander, table);
+            while (j < removed->count && removed->runs[j].end <= chunks[i].start) j++;
+            chunks[i].removed = removed->runs + j;
+            while (j + chunks[i].removed_count < removed->count &&
+                   removed->runs[j + chunks[i].removed_count].start < chunks[i].end) {
+                chunks[i].removed_count++;
+            }
+        }
+
+        /* The first chunk is expanded on the calling thread */
+        for (i = 1; i < chunk_count; i++) {
+            started[i] = pthread_create(&threads[i], NULL, expand_chunk, &chunks[i]) == 0;
+        }
+        if (chunk_count > 0) expand_chunk(&chunks[0]);
+        for (i = 1; i < chunk_count; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            } else {
+                expand_chunk(&chunks[i]);
+            }
+        }
+
+        /* Join the chunks, numbering their lines from the start of the file.
+         * Source runs cut apart by the split become one span again */
+        for (i = 0; ok && i < chunk_count; i++) {
+            ok = !chunks[i].failed;
+            for (j = 0; ok && j < chunks[i].program.count; j++) {
+                span = &chunks[i].program.spans[j];
+                last = program->count > 0 ? &program->spans[program->count - 1] : NULL;
+                if (last != NULL && last->macro < 0 && span->macro < 0 && last->text + last->length == span->text) {
+                    last->length += span->length;
+                } else {
+                    ok = add_span(program, span->text, span->length, span->line_number + line_base, span->offset,
+                                  span->macro);
+                }
             }
+            line_base += chunks[i].program.line_count;
         }
+        program->line_count = line_base;
+    }
+
+    for (i = 0; chunks != NULL && i < chunk_count; i++) {
+        if (ok) arena_adopt(&table->arena, &chunks[i].expander.arena);
+        free_macro_expander(&chunks[i].expander);
+        free(chunks[i].program.spans);
     }
+    free(chunks);
+    free(threads);
+    free(started);
+    return ok;
+}
+
+/* Expand the macros of a source file into a list of spans.
+ * Runs of ordinary lines become a single span of the source buffer, and every
+ * macro call becomes a span of the stored macro body, or of its expansion
+ * when the macro takes arguments or calls other macros.
+ * All definitions are collected first, then the calls of up to thread_count
+ * chunks of the source are expanded at the same time. A call only expands a
+ * macro whose definition ends before it, and so do the calls nested in it.
+ * The source must stay open for as long as the spans are used */
+int expand_macros(MacroTable *table, Diagnostics *diagnostics, const SourceFile *source, ExpandedSource *program,
+                  int thread_count) {
+    RemovedLines removed = {0};
+    int chunk_count = thread_count;
+    double start;
+    int ok;
+
+    program->count = 0;
+    program->line_count = 0;
+    table->collect_seconds = 0;
 
-    fclose(input_file);
-    fclose(output_file);
-}
\ No newline at end of file
+    /* Without any macro definition the whole file is a single span */
+    if (!contains_text(source->data, source->size, "macr", 4)) {
+        program->line_count = count_lines(source->data, source->size);
+        return add_span(program, source->data, source->size, 1, 0, -1);
+    }
+
+    start = stats_clock();
+    if (!collect_macros(table, diagnostics, source, &removed)) {
+        free(removed.runs);
+        return 0;
+    }
+    find_nested_calls(table);
+    table->collect_seconds = stats_clock() - start;
+
+    if ((size_t)chunk_count > source->size / EXPANSION_MIN_CHUNK_SIZE) {
+        chunk_count = (int)(source->size / EXPANSION_MIN_CHUNK_SIZE);
+    }
+    if (chunk_count < 1) chunk_count = 1;
+
+    ok = expand_chunks(table, diagnostics, source, &removed, program, chunk_count);
+
+    free(removed.runs);
+    return ok;
+}
+
+/* Write the expanded program, e.g. as the .am file */
+int write_expanded_source(const ExpandedSource *program, const char *output_name) {
+    FILE *output_file = fopen(output_name, "w");
+    const SourceSpan *span;
+    int i;
+
+    if (output_file == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < program->count; i++) {
+        span = &program->spans[i];
+        fwrite(span->text, 1, span->length, output_file);
+        /* The last line of the file may have no newline */
+        if (span->text[span->length - 1] != '\n') {
+            fputc('\n', output_file);
+        }
+    }
+
+    return fclose(output_file) == 0;
+}
+
+void free_expanded_source(ExpandedSource *program) {
+    free(program->spans);
+    program->spans = NULL;
+    program->count = 0;
+    program->capacity = 0;
+    program->line_count = 0;
+}
+
+void span_cursor_init(SpanCursor *cursor, const ExpandedSource *program) {
+    cursor->program = program;
+    cursor->span = -1;
+    cursor->reader.position = 0;
+    cursor->reader.size = 0;
+}
+
+/* Get the next line of the expanded program.
+ * Lines of a macro body all report the line of the macro call */
+int span_next_line(SpanCursor *cursor, LineView *line) {
+    const SourceSpan *span;
+
+    while (!source_next_line(&cursor->reader, line)) {
+        if (++cursor->span >= cursor->program->count) return 0;
+
+        span = &cursor->program->spans[cursor->span];
+        cursor->reader.data = span->text;
+        cursor->reader.size = span->length;
+        cursor->reader.position = 0;
+        cursor->reader.line_number = span->line_number - 1;
+        cursor->reader.is_mapped = 0;
+    }
+
+    span = &cursor->program->spans[cursor->span];
+    if (span->macro >= 0) {
+        line->line_number = span->line_number;
+        line->offset = span->offset;
+    } else {
+        line->offset += span->offset;
+    }
+    return 1;
+}
@@ -4,34 +4,135 @@
 #define MACROS_H
 
 #include <stdio.h>
+#include "source_reader.h"
+#include "arena.h"
+#include "diagnostics.h"
 
-#define MAX_MACROS 100
-#define MAX_MACRO_CONTENT 1000
+/* Limits of macro definitions and calls */
+#define MAX_MACRO_PARAMETERS 8
+#define MAX_MACRO_DEPTH 16    /* Macros being expanded at once, the called one included */
 
-/* Structure to store macro information */
+/* A parameter name, or an argument of a call */
 typedef struct {
-    char name[70];
-    char content[MAX_MACRO_CONTENT];
+    const char *text;
+    size_t length;
+} MacroWord;
+
+/* Structure to store macro information.
+ * The name, parameters and body live in the macro arena; the body is not null terminated */
+typedef struct {
+    const char *name;
+    size_t name_length;
+    const char *content;
+    size_t content_length;
+    size_t defined_at;   /* File offset after the endmacr line, calls before it are not expanded */
+    MacroWord *parameters;
+    int parameter_count;
+    int calls_macros;    /* A body line starts with the name of a macro */
 } Macro;
 
+/* Open-addressing index slot over macro names */
+typedef struct {
+    unsigned int hash;
+    int macro;  /* Index into macros, -1 if the slot is empty */
+} MacroSlot;
+
+/* Table of defined macros, grown as needed. Names and bodies are in the arena */
+typedef struct {
+    Macro *macros;
+    int count;
+    int capacity;
+    MacroSlot *slots;   /* Kept at most half full */
+    unsigned int slot_mask;
+    Arena arena;
+    double collect_seconds;     /* Time the last expand_macros spent collecting definitions */
+} MacroTable;
+
+/* A piece of the expanded program. It is either a run of source lines,
+ * pointing into the source buffer, or the body of a stored macro that
+ * replaces a macro call. Nothing is copied */
+typedef struct {
+    const char *text;
+    size_t length;
+    int line_number;   /* First source line of the run, or the line of the macro call */
+    size_t offset;     /* File offset of text, or of the macro call */
+    int macro;         /* Index of the expanded macro, -1 for source text */
+} SourceSpan;
+
+/* The program after macro expansion, as an ordered list of spans */
+typedef struct {
+    SourceSpan *spans;
+    int count;
+    int capacity;
+    int line_count;    /* Lines of the source, macro definitions included */
+} ExpandedSource;
+
+/* A cached expansion of a macro for one list of arguments. Which nested
+ * calls it expanded depends on the limit of the call; the text holds for
+ * every limit from valid_from up to but not including valid_until */
+typedef struct {
+    int macro;
+    const char *arguments;     /* The arguments without spaces, joined by commas */
+    size_t arguments_length;
+    const char *text;
+    size_t length;
+    int depth;                 /* Macros expanded at once, the called one included */
+    size_t valid_from;
+    size_t valid_until;
+} MacroExpansion;
+
+/* Expands calls of macros that take arguments or call other macros, and
+ * keeps every expansion so that repeating a call costs one lookup. An
+ * expander is only used by one thread at a time */
+typedef struct {
+    const MacroTable *table;
+    MacroExpansion *expansions;
+    int count;
+    int capacity;
+    MacroSlot *slots;                          /* Index over macro and arguments, at most half full */
+    unsigned int slot_mask;
+    char *buffers[MAX_MACRO_DEPTH];            /* Text being built for each macro being expanded */
+    size_t buffer_capacities[MAX_MACRO_DEPTH];
+    int active[MAX_MACRO_DEPTH];               /* Macros being expanded, the outermost first */
+    int depth;
+    Arena arena;                               /* Arguments and texts of the expansions */
+} MacroExpander;
+
+/* Results of expand_macro_call */
+#define MACRO_EXPANDED 1
+#define MACRO_ERROR 0
+#define MACRO_NO_MEMORY (-1)
+
+/* Sources smaller than this per thread are expanded on one thread */
+#ifndef EXPANSION_MIN_CHUNK_SIZE
+#define EXPANSION_MIN_CHUNK_SIZE 65536
+#endif
+
+/* Iterator over the lines of an expanded program */
+typedef struct {
+    const ExpandedSource *program;
+    int span;
+    SourceFile reader;
+} SpanCursor;
+
 /* Function declarations */
-int word_in_list(const char *word, const char *list[], int list_count);
 int can_be_macro_name(const char *word);
-void handle_macro_inside(const char *macro_name, FILE *file);
-void replace_macros(const char *input_name, const char *output_name);
-
-/* External variables to store macros */
-extern Macro macros[MAX_MACROS];
-extern int macro_count;
-
-/* External declarations for word groups */
-extern const char *group1[];
-extern const int group1_count;
-extern const char *group2[];
-extern const int group2_count;
-extern const char *group3[];
-extern const int group3_count;
-extern const char *instruction_words[];
-extern const int instruction_words_count;
-
-#endif /* MACROS_H */
\ No newline at end of file
+void init_macro_table(MacroTable *table);
+int find_macro(const MacroTable *table, const char *name, size_t length);
+void clear_macro_table(MacroTable *table);
+void free_macro_table(MacroTable *table);
+int expand_macros(MacroTable *table, Diagnostics *diagnostics, const SourceFile *source, ExpandedSource *program,
+                  int thread_count);
+int write_expanded_source(const ExpandedSource *program, const char *output_name);
+void free_expanded_source(ExpandedSource *program);
+
+void init_macro_expander(MacroExpander *expander, const MacroTable *table);
+void clear_macro_expander(MacroExpander *expander);
+void free_macro_expander(MacroExpander *expander);
+int expand_macro_call(MacroExpander *expander, int macro, const char *arguments, size_t length, size_t limit,
+                      Diagnostics *diagnostics, int line_number, const char **text, size_t *text_length);
+
+void span_cursor_init(SpanCursor *cursor, const ExpandedSource *program);
+int span_next_line(SpanCursor *cursor, LineView *line);
+
+#endif /* MACROS_H */
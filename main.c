@@ -1,86 +1,82 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "macros.h"
+#include "batch.h"
+#include "cache.h"
+#include "stats.h"
+#include "watch.h"
 
-// Declare findCommand function
-int findCommand(const char* line);
+/* Function to display usage instructions */
+static void print_usage(const char *prog_name) {
+    printf("Usage: %s [--cache-dir DIR] [--stats[=text|json]] [--max-errors N] <file1.as> [file2.as ...]\n", prog_name);
+    printf("       %s [--cache-dir DIR] [--stats[=text|json]] [--max-errors N] --watch DIR\n", prog_name);
+}
 
-int main() {
-    const char *input =
-            "MAIN: add r3, LIST\n"
-            "LOOP: prn #48\n"
-            "      macr m_macr\n"
-            "      cmp r3, #-6\n"
-            "      bne END\n"
-            "endmacr\n"
-            "      lea STR, r6\n"
-            "      inc r6\n"
-            "      mov *r6, K\n"
-            "      sub r1, r4\n"
-            "      m_macr\n"
-            "      dec K\n"
-            "      jmp LOOP\n"
-            "END:  stop\n"
-            "STR:  .string \"abcd\"\n"
-            "LIST: .data 6, -9\n"
-            "      .data -100\n"
-            "K:    .data 31\n";
+int main(int argc, char *argv[]) {
+    BatchOptions options;
+    AssemblyStats stats;
+    int stats_format = -1; /* -1 for no statistics, otherwise 1 for JSON */
+    const char *watch_dir = NULL;
+    double start;
+    int file_count = 0;
+    int failed;
+    int i;
 
-    // Create temporary input file
-    FILE *temp_input = fopen("temp_input.as", "w");
-    if (temp_input == NULL) {
-        perror("Failed to create temporary input file");
-        return 1;
-    }
-    fputs(input, temp_input);
-    fclose(temp_input);
-
-    // Create output file
-    const char *output_filename = "output.as";
+    options.worker_count = 0; /* One worker per core */
+    options.cache_dir = NULL;
+    options.stats = NULL;
+    options.max_errors = 0;
 
-    // Process macros (only once)
-    printf("Processing macros:\n");
-    replace_macros("temp_input.as", output_filename);
-
-    // Print defined macros
-    printf("Defined macros:\n");
-    int i = 0;
-    for(i = 0; i < macro_count; i++) {
-        printf("Macro name: %s\n", macros[i].name);
-        printf("Macro content:\n%s", macros[i].content);
-        printf("--------------------\n");
+    /* Options are removed from argv, leaving only the file names */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            options.cache_dir = argv[i] + 12;
+        } else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0) {
+            stats_format = 0;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_format = 1;
+        } else if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < argc) {
+            options.max_errors = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--max-errors=", 13) == 0) {
+            options.max_errors = atoi(argv[i] + 13);
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watch_dir = argv[++i];
+        } else if (strncmp(argv[i], "--watch=", 8) == 0) {
+            watch_dir = argv[i] + 8;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            argv[1 + file_count++] = argv[i];
+        }
     }
 
-    // Open the processed output file for reading
-    FILE *output_file = fopen(output_filename, "r");
-    if (output_file == NULL) {
-        perror("Failed to open output file");
+    /* Check that at least one file is given, or only a directory to watch */
+    if ((file_count == 0) == (watch_dir == NULL)) {
+        print_usage(argv[0]);
         return 1;
     }
 
-    printf("Processed output with opcode checking:\n\n");
-    char line[256];
-    while (fgets(line, sizeof(line), output_file)) {
-        // Remove newline character if present
-        line[strcspn(line, "\n")] = 0;
+    if (options.cache_dir != NULL && !cache_prepare(options.cache_dir)) {
+        fprintf(stderr, "Warning: cannot use cache directory %s\n", options.cache_dir);
+        options.cache_dir = NULL;
+    }
 
-        // Check for opcode
-        int cmdPos = findCommand(line);
-        if (cmdPos != -1) {
-            printf("Line: %s\n", line);
-            printf("Opcode found at position: %d\n", cmdPos);
-            printf("Opcode: %.*s\n", (int)(strchr(line + cmdPos, ' ') - (line + cmdPos)), line + cmdPos);
-        } else {
-            printf("Line: %s\n", line);
-            printf("No valid opcode found\n");
-        }
-        printf("--------------------\n");
+    if (stats_format >= 0) {
+        init_stats(&stats);
+        options.stats = &stats;
     }
-    fclose(output_file);
 
-    // Clean up
-    remove("temp_input.as");
+    if (watch_dir != NULL) {
+        return watch_directory(watch_dir, &options, stats_format);
+    }
 
-    return 0;
-}
\ No newline at end of file
+    start = stats_clock();
+    failed = assemble_files(argv + 1, file_count, &options);
+    if (options.stats != NULL) {
+        print_stats(&stats, stats_clock() - start, stats_format, stdout);
+    }
+    return failed == 0 ? 0 : 1;
+}
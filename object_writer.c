@@ -0,0 +1,168 @@
+#include "object_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OBJECT_LINE_LENGTH 12      /* Address up to 5 digits, space, 5 octal digits, newline */
+#define OBJECT_HEADER_LENGTH 32
+#define REFERENCE_LINE_LENGTH (MAX_SYMBOL_LENGTH + 8)
+
+/* Two octal digits for every 6-bit value, two decimal digits for 0-99.
+ * Words and addresses are formatted from these instead of printf */
+static const char octal_pairs[] =
+        "0001020304050607101112131415161720212223242526273031323334353637"
+        "4041424344454647505152535455565760616263646566677071727374757677";
+static const char decimal_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+static char* put_address(char* out, int address);
+static char* put_word(char* out, MachineWord word);
+static char* put_count(char* out, int count);
+
+/* At least 4 decimal digits, zero padded */
+static char* put_address(char* out, int address) {
+    if (address >= 10000) {
+        *out++ = (char)('0' + address / 10000);
+        address %= 10000;
+    }
+    memcpy(out, decimal_pairs + (address / 100) * 2, 2);
+    memcpy(out + 2, decimal_pairs + (address % 100) * 2, 2);
+    return out + 4;
+}
+
+/* A 15-bit word as 5 octal digits */
+static char* put_word(char* out, MachineWord word) {
+    out[0] = (char)('0' + ((word >> 12) & 7));
+    memcpy(out + 1, octal_pairs + ((word >> 6) & 63) * 2, 2);
+    memcpy(out + 3, octal_pairs + (word & 63) * 2, 2);
+    return out + 5;
+}
+
+/* A count without padding, for the header line */
+static char* put_count(char* out, int count) {
+    char digits[12];
+    int length = 0;
+
+    do {
+        digits[length++] = (char)('0' + count % 10);
+        count /= 10;
+    } while (count > 0);
+
+    while (length > 0) *out++ = digits[--length];
+    return out;
+}
+
+size_t object_file_size(const AssemblerContext* context) {
+    return OBJECT_HEADER_LENGTH + (size_t)(context->IC - 100 + context->DC) * OBJECT_LINE_LENGTH;
+}
+
+size_t format_object_file(const AssemblerContext* context, char* buffer) {
+    int word_count = context->IC - 100 + context->DC;
+    char* out = buffer;
+    int i;
+
+    /* Header: number of code words and number of data words */
+    *out++ = ' ';
+    *out++ = ' ';
+    out = put_count(out, context->IC - 100);
+    *out++ = ' ';
+    out = put_count(out, context->DC);
+    *out++ = '\n';
+
+    for (i = 0; i < word_count; i++) {
+        out = put_address(out, 100 + i);
+        *out++ = ' ';
+        out = put_word(out, IMAGE_WORD(&context->image.code, i));
+        *out++ = '\n';
+    }
+    return (size_t)(out - buffer);
+}
+
+size_t references_size(const ReferenceList* references) {
+    return (size_t)references->count * REFERENCE_LINE_LENGTH;
+}
+
+size_t format_references(const ReferenceList* references, char* buffer) {
+    char* out = buffer;
+    size_t length;
+    int i;
+
+    for (i = 0; i < references->count; i++) {
+        length = strlen(references->items[i].name);
+        memcpy(out, references->items[i].name, length);
+        out += length;
+        *out++ = ' ';
+        out = put_address(out, references->items[i].address);
+        *out++ = '\n';
+    }
+    return (size_t)(out - buffer);
+}
+
+int write_output_file(const char* name, const char* buffer, size_t length) {
+    FILE* file = fopen(name, "wb");
+    int written;
+
+    if (file == NULL) return 0;
+    written = fwrite(buffer, 1, length, file) == length;
+    return (fclose(file) == 0) && written;
+}
+
+int write_object_files(AssemblerContext* context, const char* base, size_t base_length) {
+    const ReferenceList* tables[2];
+    static const char* const extensions[2] = {".ent", ".ext"};
+    size_t needed = object_file_size(context);
+    size_t length;
+    char* name;
+    char* grown;
+    int ok = 1;
+    int i;
+
+    tables[0] = &context->entries;
+    tables[1] = &context->externals;
+    for (i = 0; i < 2; i++) {
+        if (references_size(tables[i]) > needed) needed = references_size(tables[i]);
+    }
+
+    /* One buffer for all three files, kept in the context for the next file */
+    if (needed > context->output_capacity) {
+        grown = realloc(context->output, needed);
+        if (grown == NULL) {
+            report_error(&context->diagnostics, 0, "Out of memory");
+            return 0;
+        }
+        context->output = grown;
+        context->output_capacity = needed;
+    }
+
+    name = malloc(base_length + 5);
+    if (name == NULL) {
+        report_error(&context->diagnostics, 0, "Out of memory");
+        return 0;
+    }
+    memcpy(name, base, base_length);
+
+    strcpy(name + base_length, ".ob");
+    length = format_object_file(context, context->output);
+    if (!write_output_file(name, context->output, length)) {
+        report_error(&context->diagnostics, 0, "Cannot write file %s", name);
+        ok = 0;
+    }
+
+    for (i = 0; i < 2; i++) {
+        strcpy(name + base_length, extensions[i]);
+        if (tables[i]->count == 0) {
+            remove(name);
+            continue;
+        }
+        length = format_references(tables[i], context->output);
+        if (!write_output_file(name, context->output, length)) {
+            report_error(&context->diagnostics, 0, "Cannot write file %s", name);
+            ok = 0;
+        }
+    }
+
+    free(name);
+    return ok;
+}
@@ -0,0 +1,24 @@
+#ifndef OBJECT_WRITER_H
+#define OBJECT_WRITER_H
+
+#include <stddef.h>
+#include "assembler.h"
+
+/* Format the object file (.ob) of an assembled context into a buffer large
+ * enough for object_file_size() bytes. Returns the number of bytes written */
+size_t format_object_file(const AssemblerContext* context, char* buffer);
+size_t object_file_size(const AssemblerContext* context);
+
+/* Format an entries (.ent) or externals (.ext) table the same way */
+size_t format_references(const ReferenceList* references, char* buffer);
+size_t references_size(const ReferenceList* references);
+
+/* Create a file and fill it with a single write, returns 0 on failure */
+int write_output_file(const char* name, const char* buffer, size_t length);
+
+/* Write base.ob, base.ent and base.ext. The .ent and .ext files are only
+ * created when they have content, a stale one from an earlier run is removed.
+ * Returns 0 and reports an error if a file cannot be written */
+int write_object_files(AssemblerContext* context, const char* base, size_t base_length);
+
+#endif /* OBJECT_WRITER_H */
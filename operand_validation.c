@@ -1,89 +1,44 @@
 #include "operand_validation.h"
-#include "opcode_groups.h"
+#include "directives.h"
 #include <ctype.h>
-#include <string.h>
 
-int find_command(const char* line) {
-    int i, j;
-    int cmdLen;
-
-    /* Skip spaces and labels */
-    while (*line && isspace((unsigned char)*line)) line++;
-    if (is_label(line)) {
-        line = strchr(line, ':') + 1;
-        while (*line && isspace((unsigned char)*line)) line++;
-    }
-
-    /* Check opcode groups */
-    for (j = 0; j < TWO_OPERAND_COUNT; j++) {
-        cmdLen = strlen(two_operand_opcodes[j]);
-        if (strncmp(line, two_operand_opcodes[j], cmdLen) == 0 &&
-            (line[cmdLen] == '\0' || isspace((unsigned char)line[cmdLen]))) {
-            return (int)(line - strchr(line, line[0]));
-        }
-    }
-
-    for (j = 0; j < ONE_OPERAND_COUNT; j++) {
-        cmdLen = strlen(one_operand_opcodes[j]);
-        if (strncmp(line, one_operand_opcodes[j], cmdLen) == 0 &&
-            (line[cmdLen] == '\0' || isspace((unsigned char)line[cmdLen]))) {
-            return (int)(line - strchr(line, line[0]));
-        }
-    }
-
-    for (j = 0; j < ZERO_OPERAND_COUNT; j++) {
-        cmdLen = strlen(zero_operand_opcodes[j]);
-        if (strncmp(line, zero_operand_opcodes[j], cmdLen) == 0 &&
-            (line[cmdLen] == '\0' || isspace((unsigned char)line[cmdLen]))) {
-            return (int)(line - strchr(line, line[0]));
-        }
-    }
-
-    return -1; /* No valid command found */
+size_t word_length(const char* text, const char* end) {
+    const char* start = text;
+    while (text < end && !isspace((unsigned char)*text)) text++;
+    return (size_t)(text - start);
 }
 
-int is_label(const char* str) {
-    int i = 0;
-
-    if (!isalpha((unsigned char)str[i])) return 0;
-
-    while (str[++i] != '\0' && str[i] != ':') {
-        if (!isalnum((unsigned char)str[i])) return 0;
-    }
-
-    return (str[i] == ':' && i > 1);
+int validate_operand(const Operand* operand, int legal_modes) {
+    return operand->is_valid && (legal_modes & (1 << operand->method)) != 0;
 }
 
-int validate_operand(const char* operand, int command_group) {
-    /* Implement operand validation logic here */
-    return 1; /* Placeholder return */
+int immediate_in_range(const Operand* operand) {
+    return operand->method != ADDR_IMMEDIATE || (operand->value >= DATA_MIN && operand->value <= DATA_MAX);
 }
 
-int count_operands(const char* line) {
-    return (strchr(line, ',') != NULL) ? 2 : (strchr(line, ' ') != NULL ? 1 : 0);
-}
-
-void extract_operands(const char* line, char* first_operand, char* second_operand) {
-    const char* start;
-    const char* end;
-    size_t length;
-
-    start = strchr(line, ' ');
-    if (start == NULL) return;
-    start++;
-
-    end = strchr(start, ',');
-    if (end == NULL) {
-        strcpy(first_operand, start);
-        return;
+int check_operands(const Statement* statement) {
+    const Keyword* command = statement->keyword;
+    const Operand* operands = statement->operands;
+    int i;
+
+    if (statement->operand_count != command->operand_count) return OPERANDS_WRONG_COUNT;
+    if (statement->malformed) return OPERANDS_INVALID;
+
+    /* A single operand is the destination */
+    switch (command->operand_count) {
+        case 2:
+            if (!validate_operand(&operands[0], command->src_modes) ||
+                !validate_operand(&operands[1], command->dst_modes)) {
+                return OPERANDS_INVALID;
+            }
+            break;
+        case 1:
+            if (!validate_operand(&operands[0], command->dst_modes)) return OPERANDS_INVALID;
+            break;
     }
 
-    length = end - start;
-    strncpy(first_operand, start, length);
-    first_operand[length] = '\0';
-
-    start = end + 1;
-    while (*start && isspace((unsigned char)*start)) start++;
-
-    strcpy(second_operand, start);
-}
\ No newline at end of file
+    for (i = 0; i < command->operand_count; i++) {
+        if (!immediate_in_range(&operands[i])) return OPERANDS_OUT_OF_RANGE;
+    }
+    return OPERANDS_VALID;
+}
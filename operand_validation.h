@@ -2,20 +2,27 @@
 #define OPERAND_VALIDATION_H
 
 #include <stddef.h>
+#include "keywords.h"
+#include "lexer.h"
 
-/* Find and validate a command in a line */
-int find_command(const char* line);
+/* Results of check_operands */
+#define OPERANDS_VALID 0
+#define OPERANDS_WRONG_COUNT 1
+#define OPERANDS_INVALID 2
+#define OPERANDS_OUT_OF_RANGE 3   /* An immediate does not fit the operand word */
 
-/* Check if a string is a valid label */
-int is_label(const char* str);
+/* Get the length of the word starting at text, up to whitespace or end */
+size_t word_length(const char* text, const char* end);
 
-/* Validate an operand */
-int validate_operand(const char* operand, int command_group);
+/* Validate an operand against a mask of legal addressing methods */
+int validate_operand(const Operand* operand, int legal_modes);
 
-/* Count operands in a line */
-int count_operands(const char* line);
+/* Whether an operand is not an immediate or its value fits the operand
+ * word, which takes the same range as a .data value */
+int immediate_in_range(const Operand* operand);
 
-/* Extract operands from a line */
-void extract_operands(const char* line, char* first_operand, char* second_operand);
+/* Check the operands of an instruction statement against its opcode.
+ * Returns one of the OPERANDS_ results */
+int check_operands(const Statement* statement);
 
-#endif /* OPERAND_VALIDATION_H */
\ No newline at end of file
+#endif /* OPERAND_VALIDATION_H */
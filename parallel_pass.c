@@ -0,0 +1,454 @@
+#include "parallel_pass.h"
+#include "first_pass.h"
+#include "lexer.h"
+#include "directives.h"
+#include "operand_validation.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kinds of ChunkSymbol */
+#define CHUNK_REFERENCE 0       /* Symbol operand */
+#define CHUNK_CODE_LABEL 1
+#define CHUNK_DATA_LABEL 2
+#define CHUNK_EXTERN 3
+#define CHUNK_ENTRY 4
+
+/* A label, symbol operand or .extern/.entry name met in a chunk, in the
+ * order the sequential first pass would meet it. Symbol indices depend on
+ * that order */
+typedef struct {
+    const char* name;
+    size_t length;
+    int kind;
+    int address;            /* Chunk relative address or DC of a label, line of an .entry */
+    int symbol;             /* Index in the symbol table once the chunks are merged */
+} ChunkSymbol;
+
+/* One part of the program, worked on by one thread */
+typedef struct {
+    AssemblerContext* context;    /* Shared, chunks only read it or write their own slices */
+    ExpandedSource program;       /* Spans of the chunk, the first and last ones trimmed */
+    InstructionList instructions; /* Chunk relative addresses, direct operands name a ChunkSymbol */
+    ChunkSymbol* symbols;
+    int symbol_count;
+    int symbol_capacity;
+    int word_count;
+    int base;                     /* Address of the first word, from the prefix sum */
+    WordBuffer data;              /* Data words of the chunk */
+    int data_base;                /* DC of the first data word, from the prefix sum */
+    int first_instruction;        /* Index of the first instruction in the whole program */
+    FixupList fixups;
+    int failed;
+} Chunk;
+
+typedef void* (*ChunkTask)(void* chunk);
+
+static int add_chunk_span(ExpandedSource* program, const SourceSpan* span, const char* text, size_t length,
+                          int line_number, size_t offset);
+static int split_program(const ExpandedSource* program, Chunk* chunks, int chunk_count);
+static int add_chunk_symbol(Chunk* chunk, const char* name, size_t length, int kind, int address);
+static int chunk_directive(Chunk* chunk, const LineView* line, const Statement* statement);
+static int chunk_payload(Chunk* chunk, const Operand* operand);
+static void chunk_line(Chunk* chunk, const LineView* line);
+static void* lex_chunk(void* argument);
+static void* encode_chunk(void* argument);
+static void run_chunks(Chunk* chunks, int chunk_count, ChunkTask task);
+static int merge_chunks(AssemblerContext* context, Chunk* chunks, int chunk_count);
+static void free_chunks(Chunk* chunks, int chunk_count);
+
+static int add_chunk_span(ExpandedSource* program, const SourceSpan* span, const char* text, size_t length,
+                          int line_number, size_t offset) {
+    SourceSpan* piece;
+
+    if (length == 0) return 1;
+    if (program->count == program->capacity) {
+        int capacity = program->capacity ? program->capacity * 2 : 16;
+        SourceSpan* grown = realloc(program->spans, (size_t)capacity * sizeof(SourceSpan));
+        if (grown == NULL) return 0;
+        program->spans = grown;
+        program->capacity = capacity;
+    }
+
+    piece = &program->spans[program->count++];
+    piece->text = text;
+    piece->length = length;
+    piece->line_number = line_number;
+    piece->offset = offset;
+    piece->macro = span->macro;
+    return 1;
+}
+
+/* Cut the program into chunks of about the same size. A cut is always
+ * right after a newline, and the piece of a source span after a cut starts
+ * at the line number it has in the file. Returns 0 if out of memory */
+static int split_program(const ExpandedSource* program, Chunk* chunks, int chunk_count) {
+    const SourceSpan* span;
+    const char *text, *newline, *scan;
+    size_t total = 0, target, filled = 0, length, offset, piece;
+    int line_number;
+    int current = 0;
+    int i;
+
+    for (i = 0; i < program->count; i++) total += program->spans[i].length;
+    target = total / (size_t)chunk_count;
+
+    for (i = 0; i < program->count; i++) {
+        span = &program->spans[i];
+        text = span->text;
+        length = span->length;
+        line_number = span->line_number;
+        offset = span->offset;
+
+        while (current < chunk_count - 1 && filled + length > target) {
+            newline = memchr(text + (target > filled ? target - filled : 0), '\n',
+                             length - (target > filled ? target - filled : 0));
+            if (newline == NULL) break;
+
+            piece = (size_t)(newline + 1 - text);
+            if (!add_chunk_span(&chunks[current].program, span, text, piece, line_number, offset)) return 0;
+
+            /* Lines of a macro body all carry the line of the call */
+            if (span->macro < 0) {
+                for (scan = text; (scan = memchr(scan, '\n', (size_t)(newline + 1 - scan))) != NULL; scan++) {
+                    line_number++;
+                }
+                offset += piece;
+            }
+            text += piece;
+            length -= piece;
+            current++;
+            filled = 0;
+        }
+
+        if (!add_chunk_span(&chunks[current].program, span, text, length, line_number, offset)) return 0;
+        filled += length;
+    }
+    return 1;
+}
+
+static int add_chunk_symbol(Chunk* chunk, const char* name, size_t length, int kind, int address) {
+    ChunkSymbol* symbol;
+
+    if (chunk->symbol_count == chunk->symbol_capacity) {
+        int capacity = chunk->symbol_capacity ? chunk->symbol_capacity * 2 : 256;
+        ChunkSymbol* grown = realloc(chunk->symbols, (size_t)capacity * sizeof(ChunkSymbol));
+        if (grown == NULL) return -1;
+        chunk->symbols = grown;
+        chunk->symbol_capacity = capacity;
+    }
+
+    symbol = &chunk->symbols[chunk->symbol_count];
+    symbol->name = name;
+    symbol->length = length;
+    symbol->kind = kind;
+    symbol->address = address;
+    symbol->symbol = -1;
+    return chunk->symbol_count++;
+}
+
+/* The payload of an operand within the chunk, see add_statement */
+static int chunk_payload(Chunk* chunk, const Operand* operand) {
+    int symbol;
+
+    if (operand->method != ADDR_DIRECT) return operand->value;
+    symbol = add_chunk_symbol(chunk, operand->text, operand->length, CHUNK_REFERENCE, 0);
+    if (symbol < 0) chunk->failed = 1;
+    return symbol;
+}
+
+/* handle_directive for a chunk, returns 0 on an error */
+static int chunk_directive(Chunk* chunk, const LineView* line, const Statement* statement) {
+    const char* error;
+
+    switch (statement->keyword->value) {
+        case DIRECTIVE_DATA:
+            return parse_data(statement->arguments, statement->arguments_length, &chunk->data, &error) ==
+                   ARGUMENTS_VALID;
+        case DIRECTIVE_STRING:
+            return parse_string(statement->arguments, statement->arguments_length, &chunk->data) ==
+                   ARGUMENTS_VALID;
+        default:
+            if (check_symbol_argument(statement->arguments, statement->arguments_length) != ARGUMENTS_VALID) {
+                return 0;
+            }
+            if (statement->keyword->value == DIRECTIVE_ENTRY) {
+                return add_chunk_symbol(chunk, statement->arguments, statement->arguments_length, CHUNK_ENTRY,
+                                        line->line_number) >= 0;
+            }
+            return add_chunk_symbol(chunk, statement->arguments, statement->arguments_length, CHUNK_EXTERN, 0) >= 0;
+    }
+}
+
+/* first_pass_line for a chunk. Symbols are only recorded, and a line with
+ * an error fails the chunk; the sequential pass reports it */
+static void chunk_line(Chunk* chunk, const LineView* line) {
+    Statement statement;
+    const Keyword* command;
+    const Operand* destination = &statement.operands[0];
+    int source_payload = 0, destination_payload = 0;
+    int modes = 0;
+
+    if (line->length > MAX_LINE_LENGTH) {
+        chunk->failed = 1;
+        return;
+    }
+
+    lex_line(line->text, line->length, &statement);
+    if (statement.kind == STATEMENT_EMPTY) return;
+
+    if (statement.kind == STATEMENT_DIRECTIVE) {
+        if (statement.label_length > 0 &&
+            (statement.keyword->value == DIRECTIVE_DATA || statement.keyword->value == DIRECTIVE_STRING) &&
+            add_chunk_symbol(chunk, statement.label, statement.label_length, CHUNK_DATA_LABEL,
+                             chunk->data.count) < 0) {
+            chunk->failed = 1;
+            return;
+        }
+        if (!chunk_directive(chunk, line, &statement)) chunk->failed = 1;
+        return;
+    }
+
+    if (statement.label_length > 0 &&
+        add_chunk_symbol(chunk, statement.label, statement.label_length, CHUNK_CODE_LABEL, chunk->word_count) < 0) {
+        chunk->failed = 1;
+        return;
+    }
+
+    if (statement.kind != STATEMENT_INSTRUCTION || check_operands(&statement) != OPERANDS_VALID) {
+        chunk->failed = 1;
+        return;
+    }
+
+    command = statement.keyword;
+    if (command->operand_count == 2) {
+        source_payload = chunk_payload(chunk, &statement.operands[0]);
+        modes |= IR_HAS_SOURCE | IR_MODES(statement.operands[0].method, 0);
+        destination = &statement.operands[1];
+    }
+    if (command->operand_count >= 1) {
+        destination_payload = chunk_payload(chunk, destination);
+        modes |= IR_HAS_DESTINATION | IR_MODES(0, destination->method);
+    }
+
+    if (!add_instruction(&chunk->instructions, command->value, modes, source_payload, destination_payload,
+                         chunk->word_count, line->line_number)) {
+        chunk->failed = 1;
+    }
+    chunk->word_count += 1 + command->operand_count;
+}
+
+static void* lex_chunk(void* argument) {
+    Chunk* chunk = argument;
+    SpanCursor cursor;
+    LineView line;
+
+    span_cursor_init(&cursor, &chunk->program);
+    while (!chunk->failed && span_next_line(&cursor, &line)) {
+        chunk_line(chunk, &line);
+    }
+    return NULL;
+}
+
+/* Copy the instructions of a chunk to their place in the program, with
+ * final addresses and symbol indices, and encode them. The data words of
+ * the chunk are copied to their place too */
+static void* encode_chunk(void* argument) {
+    Chunk* chunk = argument;
+    const InstructionList* local = &chunk->instructions;
+    InstructionList* list = &chunk->context->instructions;
+    int i, j, modes;
+
+    for (i = 0, j = chunk->first_instruction; i < local->count; i++, j++) {
+        modes = local->modes[i];
+        list->opcodes[j] = local->opcodes[i];
+        list->modes[j] = (unsigned char)modes;
+        list->addresses[j] = local->addresses[i] + chunk->base;
+        list->lines[j] = local->lines[i];
+        list->sources[j] = local->sources[i];
+        list->destinations[j] = local->destinations[i];
+        if ((modes & IR_HAS_SOURCE) && IR_SOURCE_MODE(modes) == ADDR_DIRECT) {
+            list->sources[j] = chunk->symbols[local->sources[i]].symbol;
+        }
+        if ((modes & IR_HAS_DESTINATION) && IR_DESTINATION_MODE(modes) == ADDR_DIRECT) {
+            list->destinations[j] = chunk->symbols[local->destinations[i]].symbol;
+        }
+    }
+
+    if (chunk->data.count > 0) {
+        memcpy(chunk->context->image.data.words + chunk->data_base, chunk->data.words,
+               (size_t)chunk->data.count * sizeof(MachineWord));
+    }
+
+    if (!encode_instructions(chunk->context, chunk->first_instruction, chunk->first_instruction + local->count,
+                             &chunk->fixups)) {
+        chunk->failed = 1;
+    }
+    return NULL;
+}
+
+/* Run a task on every chunk, the first one on the calling thread */
+static void run_chunks(Chunk* chunks, int chunk_count, ChunkTask task) {
+    pthread_t threads[MAX_FIRST_PASS_THREADS];
+    int started[MAX_FIRST_PASS_THREADS];
+    int i;
+
+    for (i = 1; i < chunk_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, task, &chunks[i]) == 0;
+    }
+    task(&chunks[0]);
+    for (i = 1; i < chunk_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            task(&chunks[i]);
+        }
+    }
+}
+
+/* Give every chunk its first address, DC and instruction, and enter the
+ * symbols of all chunks in program order. Returns 0 on a duplicate label,
+ * an external that is defined, an image that is too large or when out
+ * of memory */
+static int merge_chunks(AssemblerContext* context, Chunk* chunks, int chunk_count) {
+    char label[MAX_SYMBOL_LENGTH + 1];
+    ChunkSymbol* symbol;
+    size_t length;
+    int address = 100, data_count = 0, instruction_count = 0;
+    int i, j, ok;
+
+    for (i = 0; i < chunk_count; i++) {
+        if (chunks[i].failed) return 0;
+        chunks[i].base = address;
+        chunks[i].data_base = data_count;
+        chunks[i].first_instruction = instruction_count;
+        address += chunks[i].word_count;
+        data_count += chunks[i].data.count;
+        instruction_count += chunks[i].instructions.count;
+    }
+    if (address - 100 + data_count > IMAGE_MAX_WORDS ||
+        !reserve_instructions(&context->instructions, instruction_count) ||
+        !resize_words(&context->image.code, address - 100) || !resize_words(&context->image.data, data_count)) {
+        return 0;
+    }
+
+    for (i = 0; i < chunk_count; i++) {
+        for (j = 0; j < chunks[i].symbol_count; j++) {
+            symbol = &chunks[i].symbols[j];
+            if (symbol->kind == CHUNK_REFERENCE) {
+                symbol->symbol = reference_symbol(&context->symbols, symbol->name, symbol->length);
+                if (symbol->symbol < 0) return 0;
+                continue;
+            }
+
+            length = symbol->length > MAX_SYMBOL_LENGTH ? MAX_SYMBOL_LENGTH : symbol->length;
+            memcpy(label, symbol->name, length);
+            label[length] = '\0';
+            switch (symbol->kind) {
+                case CHUNK_CODE_LABEL:
+                    ok = add_symbol(&context->symbols, label, chunks[i].base + symbol->address, 0) == SYMBOL_ADDED;
+                    break;
+                case CHUNK_DATA_LABEL:
+                    ok = add_symbol(&context->symbols, label, chunks[i].data_base + symbol->address, 1) ==
+                         SYMBOL_ADDED;
+                    break;
+                case CHUNK_EXTERN:
+                    ok = mark_external(&context->symbols, label) == SYMBOL_ADDED;
+                    break;
+                default:
+                    ok = mark_entry(&context->symbols, label, symbol->address);
+                    break;
+            }
+            if (!ok) return 0;
+        }
+    }
+
+    context->IC = address;
+    context->DC = data_count;
+    relocate_data_symbols(&context->symbols, context->IC);
+    context->instructions.count = instruction_count;
+    return 1;
+}
+
+static void free_chunks(Chunk* chunks, int chunk_count) {
+    int i;
+
+    for (i = 0; i < chunk_count; i++) {
+        free(chunks[i].program.spans);
+        free_instructions(&chunks[i].instructions);
+        free(chunks[i].symbols);
+        free(chunks[i].data.words);
+        free(chunks[i].fixups.items);
+    }
+    free(chunks);
+}
+
+int parallel_first_pass(AssemblerContext* context) {
+    double* seconds = context->stats.seconds;
+    double start, finish;
+    size_t total = 0;
+    int chunk_count = context->thread_count;
+    int fixup_count = 0;
+    Chunk* chunks;
+    Fixup* grown;
+    int ok;
+    int i;
+
+    for (i = 0; i < context->program.count; i++) total += context->program.spans[i].length;
+    if ((size_t)chunk_count > total / PARALLEL_MIN_CHUNK_SIZE) chunk_count = (int)(total / PARALLEL_MIN_CHUNK_SIZE);
+    if (chunk_count > MAX_FIRST_PASS_THREADS) chunk_count = MAX_FIRST_PASS_THREADS;
+    if (chunk_count < 2) return 0;
+
+    chunks = calloc((size_t)chunk_count, sizeof(Chunk));
+    if (chunks == NULL) return 0;
+    for (i = 0; i < chunk_count; i++) {
+        chunks[i].context = context;
+        init_instructions(&chunks[i].instructions);
+    }
+
+    start = stats_clock();
+    ok = split_program(&context->program, chunks, chunk_count);
+    if (ok) {
+        run_chunks(chunks, chunk_count, lex_chunk);
+        ok = merge_chunks(context, chunks, chunk_count);
+    }
+    finish = stats_clock();
+    seconds[STATS_FIRST_PASS] += finish - start;
+
+    if (ok) {
+        run_chunks(chunks, chunk_count, encode_chunk);
+
+        /* The fixups of each chunk are in address order, and so are the chunks */
+        for (i = 0; i < chunk_count; i++) {
+            ok = ok && !chunks[i].failed;
+            fixup_count += chunks[i].fixups.count;
+        }
+        if (ok && fixup_count > context->fixups.capacity) {
+            grown = realloc(context->fixups.items, (size_t)fixup_count * sizeof(Fixup));
+            if (grown == NULL) {
+                ok = 0;
+            } else {
+                context->fixups.items = grown;
+                context->fixups.capacity = fixup_count;
+            }
+        }
+        for (i = 0; ok && i < chunk_count; i++) {
+            if (chunks[i].fixups.count == 0) continue;
+            memcpy(context->fixups.items + context->fixups.count, chunks[i].fixups.items,
+                   (size_t)chunks[i].fixups.count * sizeof(Fixup));
+            context->fixups.count += chunks[i].fixups.count;
+        }
+        seconds[STATS_ENCODING] += stats_clock() - finish;
+    }
+
+    if (!ok) {
+        clear_symbol_table(&context->symbols);
+        context->IC = 100;
+        context->DC = 0;
+        clear_image(&context->image);
+        context->instructions.count = 0;
+        context->fixups.count = 0;
+    }
+    free_chunks(chunks, chunk_count);
+    return ok;
+}
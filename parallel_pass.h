@@ -0,0 +1,30 @@
+#ifndef PARALLEL_PASS_H
+#define PARALLEL_PASS_H
+
+#include "assembler.h"
+
+/* Smallest part of the expanded program given to one thread. The first
+ * pass and encoding handle about 45 MB/s on one core, so 2 KB is some
+ * 45 us of work against about 16 us to start and join a thread. Sources
+ * are small: operands only address labels up to ADDRESS_MAX, which a
+ * source of about 1500 lines or 20 KB already reaches, so there are about
+ * 10 chunks at most */
+#ifndef PARALLEL_MIN_CHUNK_SIZE
+#define PARALLEL_MIN_CHUNK_SIZE 2048
+#endif
+
+/* Most threads working on one file */
+#define MAX_FIRST_PASS_THREADS 64
+
+/* Run the first pass and encoding of context->program on up to
+ * context->thread_count threads. The program is cut into chunks at line
+ * boundaries; every chunk is lexed and sized on its own, a prefix sum of
+ * the chunk sizes gives each chunk its first address, and the chunks are
+ * then encoded into their own slices of the image.
+ * The result is the same as perform_first_pass followed by
+ * encode_program. Returns 0, with nothing changed, if the program is too
+ * small, has an error or runs out of memory; the sequential passes are
+ * then run instead and report any errors in order */
+int parallel_first_pass(AssemblerContext* context);
+
+#endif /* PARALLEL_PASS_H */
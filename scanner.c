@@ -0,0 +1,180 @@
+#include "scanner.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*ScanFunction)(const char* text, size_t length, ScanMasks* masks);
+
+static void scan_block_scalar(const char* text, size_t length, ScanMasks* masks);
+static void scan_resolve(void);
+
+/* The implementation in use. scan_init picks one once, before any thread
+ * scans, and from then on these are only read */
+static ScanFunction scan_function = scan_block_scalar;
+static ScanLevel current_level = SCAN_SCALAR;
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+#ifndef __GNUC__
+size_t scan_first_bit(unsigned int mask) {
+    size_t i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+}
+#endif
+
+static void scan_block_scalar(const char* text, size_t length, ScanMasks* masks) {
+    unsigned int bit = 1;
+    unsigned char c;
+    size_t i;
+
+    memset(masks, 0, sizeof(ScanMasks));
+    if (length > SCAN_BLOCK_SIZE) length = SCAN_BLOCK_SIZE;
+
+    for (i = 0; i < length; i++, bit <<= 1) {
+        c = (unsigned char)text[i];
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            masks->space |= bit;
+        } else if ((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) {
+            masks->alnum |= bit;
+        } else if (c == ',') {
+            masks->comma |= bit;
+        }
+    }
+}
+
+#ifdef SCAN_X86
+
+/* Loads never cross a boundary of this size, the smallest page size */
+#define SCAN_PAGE_SIZE 4096
+
+/* A block load that stays inside one page cannot fault, even when it reads
+ * past the end of the text. Only a block that would cross into the next
+ * page is copied to a zeroed buffer first. Bits of bytes past the end are
+ * cleared from the masks afterwards. The sanitizers are told about this */
+#define SCAN_NEEDS_COPY(text, length) \
+    ((length) < SCAN_BLOCK_SIZE && ((uintptr_t)(text) & (SCAN_PAGE_SIZE - 1)) > SCAN_PAGE_SIZE - SCAN_BLOCK_SIZE)
+#define SCAN_VALID_BITS(length) ((length) < SCAN_BLOCK_SIZE ? (1u << (length)) - 1 : ~0u)
+
+#if defined(__clang__) || __GNUC__ >= 5
+#define SCAN_NO_SANITIZE __attribute__((no_sanitize_address))
+#else
+#define SCAN_NO_SANITIZE
+#endif
+
+/* Bytes of v from low to low + count - 1, as a comparison result. Moving
+ * the range to the bottom of the signed byte range needs a single compare */
+#define IN_RANGE_SSE2(v, low, count) \
+    _mm_cmplt_epi8(_mm_add_epi8((v), _mm_set1_epi8((char)(0x80 - (low)))), _mm_set1_epi8((char)(0x80 + (count))))
+
+SCAN_NO_SANITIZE
+static void scan_block_sse2(const char* text, size_t length, ScanMasks* masks) {
+    char padded[SCAN_BLOCK_SIZE];
+    __m128i v[2], alpha, space;
+    unsigned int result[3] = {0, 0, 0};
+    unsigned int valid = SCAN_VALID_BITS(length);
+    int half, shift;
+
+    if (SCAN_NEEDS_COPY(text, length)) {
+        memset(padded, 0, sizeof(padded));
+        memcpy(padded, text, length);
+        text = padded;
+    }
+    v[0] = _mm_loadu_si128((const __m128i*)text);
+    v[1] = _mm_loadu_si128((const __m128i*)(text + 16));
+
+    for (half = 0; half < 2; half++) {
+        shift = half * 16;
+        space = _mm_or_si128(_mm_cmpeq_epi8(v[half], _mm_set1_epi8(' ')), IN_RANGE_SSE2(v[half], '\t', 5));
+        alpha = IN_RANGE_SSE2(_mm_or_si128(v[half], _mm_set1_epi8(0x20)), 'a', 26);
+        result[0] |= (unsigned int)_mm_movemask_epi8(space) << shift;
+        result[1] |= (unsigned int)_mm_movemask_epi8(_mm_or_si128(alpha, IN_RANGE_SSE2(v[half], '0', 10))) << shift;
+        result[2] |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v[half], _mm_set1_epi8(','))) << shift;
+    }
+
+    masks->space = result[0] & valid;
+    masks->alnum = result[1] & valid;
+    masks->comma = result[2] & valid;
+}
+
+#define IN_RANGE_AVX2(v, low, count) \
+    _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + (count))), \
+                      _mm256_add_epi8((v), _mm256_set1_epi8((char)(0x80 - (low)))))
+
+/* The same on one 32 byte register. Compiled for AVX2 whatever the build
+ * flags are, it only runs when the processor has it */
+__attribute__((target("avx2"))) SCAN_NO_SANITIZE
+static void scan_block_avx2(const char* text, size_t length, ScanMasks* masks) {
+    char padded[SCAN_BLOCK_SIZE];
+    __m256i v, alnum, space;
+    unsigned int valid = SCAN_VALID_BITS(length);
+
+    if (SCAN_NEEDS_COPY(text, length)) {
+        memset(padded, 0, sizeof(padded));
+        memcpy(padded, text, length);
+        text = padded;
+    }
+    v = _mm256_loadu_si256((const __m256i*)text);
+
+    space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), IN_RANGE_AVX2(v, '\t', 5));
+    alnum = _mm256_or_si256(IN_RANGE_AVX2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26),
+                            IN_RANGE_AVX2(v, '0', 10));
+    masks->space = (unsigned int)_mm256_movemask_epi8(space) & valid;
+    masks->alnum = (unsigned int)_mm256_movemask_epi8(alnum) & valid;
+    masks->comma = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))) & valid;
+}
+
+#endif /* SCAN_X86 */
+
+/* Pick the fastest implementation, run through scan_once */
+static void scan_resolve(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (!scan_set_level(__builtin_cpu_supports("avx2") ? SCAN_AVX2 : SCAN_SSE2))
+#endif
+    {
+        scan_set_level(SCAN_SCALAR);
+    }
+}
+
+void scan_init(void) {
+    pthread_once(&scan_once, scan_resolve);
+}
+
+void scan_block(const char* text, size_t length, ScanMasks* masks) {
+    scan_function(text, length, masks);
+}
+
+ScanLevel scan_level(void) {
+    scan_init();
+    return current_level;
+}
+
+int scan_set_level(ScanLevel level) {
+    switch (level) {
+        case SCAN_SCALAR:
+            scan_function = scan_block_scalar;
+            break;
+#ifdef SCAN_X86
+        case SCAN_SSE2:
+            scan_function = scan_block_sse2;
+            break;
+        case SCAN_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2")) return 0;
+            scan_function = scan_block_avx2;
+            break;
+#endif
+        default:
+            return 0;
+    }
+    current_level = level;
+    return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stddef.h>
+
+/* Bytes classified by one call of scan_block */
+#define SCAN_BLOCK_SIZE 32
+
+/* The classes of every byte of a block, bit i describes byte i */
+typedef struct {
+    unsigned int space;    /* ' ', '\t', '\n', '\v', '\f' and '\r' */
+    unsigned int alnum;    /* ASCII letters and digits */
+    unsigned int comma;
+} ScanMasks;
+
+/* Implementations of scan_block, from slowest to fastest */
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} ScanLevel;
+
+/* Pick the fastest implementation the processor supports. Safe to call
+ * from several threads, only the first call does anything. init_context
+ * calls it, so every thread that assembles finds it done; until then the
+ * scalar implementation is used */
+void scan_init(void);
+
+/* Classify up to SCAN_BLOCK_SIZE bytes of text. Bytes past length belong
+ * to no class; they may be read, but never across a page boundary */
+void scan_block(const char* text, size_t length, ScanMasks* masks);
+
+/* Get the implementation in use. Unless one was forced, this is the
+ * fastest one the processor supports, see scan_init */
+ScanLevel scan_level(void);
+
+/* Force an implementation, e.g. to compare them. Call scan_init first and
+ * never while another thread scans.
+ * Returns 0 if this processor or build does not have it */
+int scan_set_level(ScanLevel level);
+
+/* Index of the lowest set bit of a non-zero mask */
+#if defined(__GNUC__)
+#define SCAN_FIRST_BIT(mask) ((size_t)__builtin_ctz(mask))
+#else
+size_t scan_first_bit(unsigned int mask);
+#define SCAN_FIRST_BIT(mask) scan_first_bit(mask)
+#endif
+
+#endif /* SCANNER_H */
@@ -0,0 +1,75 @@
+#include "second_pass.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_references(const void* left, const void* right);
+
+void perform_second_pass(AssemblerContext* context) {
+    const Fixup* fixup = context->fixups.items;
+    const Fixup* end = fixup + context->fixups.count;
+    const Symbol* symbols = context->symbols.symbols;
+    const Symbol* symbol;
+    WordBuffer* code = &context->image.code;
+
+    for (; fixup < end; fixup++) {
+        symbol = &symbols[fixup->symbol];
+
+        if (symbol->is_external) {
+            IMAGE_WORD(code, fixup->address - 100) = ARE_EXTERNAL;
+            if (!add_reference(&context->externals, symbol->name, fixup->address)) {
+                report_error(&context->diagnostics, fixup->line_number, "Out of memory");
+            }
+        } else if (symbol->is_defined && symbol->address > ADDRESS_MAX) {
+            report_error(&context->diagnostics, fixup->line_number,
+                         "Address %d of symbol '%s' does not fit in an operand word", symbol->address, symbol->name);
+        } else if (symbol->is_defined) {
+            IMAGE_WORD(code, fixup->address - 100) = (MachineWord)(((symbol->address << 3) | ARE_RELOCATABLE) & 0x7FFF);
+        } else {
+            report_error(&context->diagnostics, fixup->line_number, "Undefined symbol '%s'", symbol->name);
+        }
+    }
+
+    collect_entries(&context->symbols, 0, &context->entries, &context->diagnostics);
+}
+
+/* Order by address, then by name */
+static int compare_references(const void* left, const void* right) {
+    const SymbolReference* a = left;
+    const SymbolReference* b = right;
+
+    if (a->address != b->address) return a->address < b->address ? -1 : 1;
+    return strcmp(a->name, b->name);
+}
+
+void collect_entries(const SymbolTable* table, int data_address, ReferenceList* entries, Diagnostics* diagnostics) {
+    ReferenceList undefined;
+    const Symbol* symbol;
+    int ok = 1;
+    int i;
+
+    undefined.items = NULL;
+    undefined.count = undefined.capacity = 0;
+    for (i = 0; i < table->count && ok; i++) {
+        symbol = &table->symbols[i];
+        if (!symbol->is_entry) continue;
+
+        if (!symbol->is_defined) {
+            ok = add_reference(&undefined, symbol->name, symbol->entry_line);
+        } else {
+            ok = add_reference(entries, symbol->name,
+                               symbol->is_data ? data_address + symbol->address : symbol->address);
+        }
+    }
+    if (!ok) report_error(diagnostics, 0, "Out of memory");
+
+    if (entries->count > 1) {
+        qsort(entries->items, (size_t)entries->count, sizeof(SymbolReference), compare_references);
+    }
+    if (undefined.count > 1) {
+        qsort(undefined.items, (size_t)undefined.count, sizeof(SymbolReference), compare_references);
+    }
+    for (i = 0; i < undefined.count; i++) {
+        report_error(diagnostics, undefined.items[i].address, "Entry symbol '%s' is not defined in this file", undefined.items[i].name);
+    }
+    free(undefined.items);
+}
@@ -0,0 +1,16 @@
+#ifndef SECOND_PASS_H
+#define SECOND_PASS_H
+
+#include "assembler.h"
+
+/* Complete the words recorded as fixups by the first pass and collect the
+ * entry symbols and the uses of external symbols. The source is not read again */
+void perform_second_pass(AssemblerContext* context);
+
+/* Add the entry symbols to entries in address order and report the ones
+ * that are not defined at their first .entry line, in line and name order,
+ * so that neither depends on the order of the symbol table. data_address
+ * is added to the address of data symbols, it is 0 once they are relocated */
+void collect_entries(const SymbolTable* table, int data_address, ReferenceList* entries, Diagnostics* diagnostics);
+
+#endif /* SECOND_PASS_H */
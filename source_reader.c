@@ -0,0 +1,176 @@
+#include "source_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define READ_CHUNK_SIZE 65536
+
+static int read_whole_file(SourceFile* source, const char* filename);
+
+/* Read the whole file into one heap buffer. Used for pipes and anything
+ * else that cannot be mapped; the buffer grows geometrically */
+static int read_whole_file(SourceFile* source, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    char* buffer = NULL;
+    char* grown;
+    size_t capacity = 0;
+    size_t size = 0;
+    size_t count;
+
+    if (file == NULL) return 0;
+
+    do {
+        if (capacity - size < READ_CHUNK_SIZE) {
+            capacity = capacity ? capacity * 2 : READ_CHUNK_SIZE;
+            grown = realloc(buffer, capacity);
+            if (grown == NULL) {
+                free(buffer);
+                fclose(file);
+                return 0;
+            }
+            buffer = grown;
+        }
+        count = fread(buffer + size, 1, capacity - size, file);
+        size += count;
+    } while (count > 0);
+
+    fclose(file);
+    source->data = buffer;
+    source->size = size;
+    source->is_mapped = 0;
+    return 1;
+}
+
+int source_open(SourceFile* source, const char* filename) {
+    source->data = NULL;
+    source->size = 0;
+    source->position = 0;
+    source->line_number = 0;
+    source->is_mapped = 0;
+
+#ifndef _WIN32
+    {
+        struct stat info;
+        void* mapped;
+        int fd = open(filename, O_RDONLY);
+
+        if (fd < 0) return 0;
+
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            if (info.st_size == 0) {
+                close(fd);
+                return 1;
+            }
+            mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                close(fd);
+                source->data = mapped;
+                source->size = (size_t)info.st_size;
+                source->is_mapped = 1;
+                return 1;
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    return read_whole_file(source, filename);
+}
+
+int source_read(const char* filename, char** buffer, size_t* capacity, size_t* size) {
+    struct stat before, after;
+    FILE* file;
+    char* grown;
+    size_t grown_capacity;
+    size_t count;
+
+    if (stat(filename, &before) != 0) return SOURCE_UNREADABLE;
+    file = fopen(filename, "rb");
+    if (file == NULL) return SOURCE_UNREADABLE;
+
+    *size = 0;
+    do {
+        if (*capacity - *size < READ_CHUNK_SIZE) {
+            grown_capacity = *capacity ? *capacity * 2 : READ_CHUNK_SIZE;
+            grown = realloc(*buffer, grown_capacity);
+            if (grown == NULL) {
+                fclose(file);
+                return SOURCE_UNREADABLE;
+            }
+            *buffer = grown;
+            *capacity = grown_capacity;
+        }
+        count = fread(*buffer + *size, 1, *capacity - *size, file);
+        *size += count;
+    } while (count > 0);
+    fclose(file);
+
+    /* A file deleted or moved away since has changed too */
+    if (stat(filename, &after) != 0 || after.st_size != before.st_size || after.st_mtime != before.st_mtime ||
+        *size != (size_t)before.st_size) {
+        return SOURCE_CHANGED;
+    }
+    return SOURCE_READ;
+}
+
+void source_from_buffer(SourceFile* source, const char* data, size_t size) {
+    source->data = data;
+    source->size = size;
+    source->position = 0;
+    source->line_number = 0;
+    source->is_mapped = 0;
+}
+
+int source_next_line(SourceFile* source, LineView* line) {
+    const char* start;
+    const char* newline;
+    size_t remaining;
+
+    if (source->position >= source->size) return 0;
+
+    start = source->data + source->position;
+    remaining = source->size - source->position;
+    newline = memchr(start, '\n', remaining);
+
+    line->text = start;
+    line->offset = source->position;
+    line->line_number = ++source->line_number;
+
+    if (newline != NULL) {
+        line->length = (size_t)(newline - start);
+        source->position += line->length + 1;
+    } else {
+        line->length = remaining;
+        source->position = source->size;
+    }
+
+    /* Accept files with Windows line endings */
+    if (line->length > 0 && start[line->length - 1] == '\r') line->length--;
+    return 1;
+}
+
+int line_column(const LineView* line, const char* position) {
+    return (int)(position - line->text) + 1;
+}
+
+void source_close(SourceFile* source) {
+#ifndef _WIN32
+    if (source->is_mapped) {
+        munmap((void*)source->data, source->size);
+    } else
+#endif
+    {
+        free((void*)source->data);
+    }
+    source->data = NULL;
+    source->size = 0;
+    source->position = 0;
+}
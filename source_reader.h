@@ -0,0 +1,52 @@
+#ifndef SOURCE_READER_H
+#define SOURCE_READER_H
+
+#include <stddef.h>
+
+/* A line of the source, pointing straight into the file buffer.
+ * The text is not null terminated and excludes the line terminator */
+typedef struct {
+    const char* text;
+    size_t length;
+    int line_number;   /* 1-based line number in the file */
+    size_t offset;     /* Offset of the first character from the start of the file */
+} LineView;
+
+/* A source file loaded for reading, either mapped or read in one call */
+typedef struct {
+    const char* data;
+    size_t size;
+    size_t position;
+    int line_number;
+    int is_mapped;
+} SourceFile;
+
+/* Load a file, returns 0 if it cannot be opened or read */
+int source_open(SourceFile* source, const char* filename);
+
+/* Results of source_read */
+#define SOURCE_READ 1
+#define SOURCE_UNREADABLE 0
+#define SOURCE_CHANGED (-1)       /* The file was written to while it was read */
+
+/* Read a whole file into a buffer the caller owns and reuses, growing it
+ * as needed, and set size to the bytes read. Unlike a mapped file, the
+ * text stays intact if the file is truncated or written to later. The size
+ * and modification time are compared before and after the read to tell
+ * whether the file changed meanwhile. Returns one of the SOURCE_ results */
+int source_read(const char* filename, char** buffer, size_t* capacity, size_t* size);
+
+/* Read lines from a buffer already in memory. The buffer is not copied
+ * and stays owned by the caller, so such a source is not closed */
+void source_from_buffer(SourceFile* source, const char* data, size_t size);
+
+/* Get the next line of the file, returns 0 at the end of the file */
+int source_next_line(SourceFile* source, LineView* line);
+
+/* Get the 1-based column of a position inside a line, for diagnostics */
+int line_column(const LineView* line, const char* position);
+
+/* Release the file buffer */
+void source_close(SourceFile* source);
+
+#endif /* SOURCE_READER_H */
@@ -0,0 +1,128 @@
+#include "stats.h"
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const char* const phase_names[STATS_PHASE_COUNT] = {
+        "macro_collection", "macro_expansion", "first_pass", "encoding", "second_pass", "output"
+};
+
+void init_stats(AssemblyStats* stats) {
+    int i;
+
+    for (i = 0; i < STATS_PHASE_COUNT; i++) {
+        stats->seconds[i] = 0;
+    }
+    stats->files = 0;
+    stats->cache_hits = 0;
+    stats->lines_read = 0;
+    stats->macros_defined = 0;
+    stats->macro_expansions = 0;
+    stats->bytes_expanded = 0;
+    stats->symbols_inserted = 0;
+    stats->symbol_lookups = 0;
+    stats->symbol_probes = 0;
+    stats->words_emitted = 0;
+    stats->fixups = 0;
+    stats->peak_symbol_bytes = 0;
+    stats->peak_macro_bytes = 0;
+    stats->peak_span_bytes = 0;
+    stats->peak_instruction_bytes = 0;
+    stats->peak_image_bytes = 0;
+    stats->peak_fixup_bytes = 0;
+    stats->peak_output_bytes = 0;
+}
+
+double stats_clock(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+#endif
+}
+
+#define KEEP_LARGER(field) if (part->field > total->field) total->field = part->field
+
+void merge_stats(AssemblyStats* total, const AssemblyStats* part) {
+    int i;
+
+    for (i = 0; i < STATS_PHASE_COUNT; i++) {
+        total->seconds[i] += part->seconds[i];
+    }
+    total->files += part->files;
+    total->cache_hits += part->cache_hits;
+    total->lines_read += part->lines_read;
+    total->macros_defined += part->macros_defined;
+    total->macro_expansions += part->macro_expansions;
+    total->bytes_expanded += part->bytes_expanded;
+    total->symbols_inserted += part->symbols_inserted;
+    total->symbol_lookups += part->symbol_lookups;
+    total->symbol_probes += part->symbol_probes;
+    total->words_emitted += part->words_emitted;
+    total->fixups += part->fixups;
+    KEEP_LARGER(peak_symbol_bytes);
+    KEEP_LARGER(peak_macro_bytes);
+    KEEP_LARGER(peak_span_bytes);
+    KEEP_LARGER(peak_instruction_bytes);
+    KEEP_LARGER(peak_image_bytes);
+    KEEP_LARGER(peak_fixup_bytes);
+    KEEP_LARGER(peak_output_bytes);
+}
+
+void print_stats(const AssemblyStats* stats, double wall_seconds, int json, FILE* stream) {
+    double probe_length = stats->symbol_lookups ? (double)stats->symbol_probes / (double)stats->symbol_lookups : 0;
+    int i;
+
+    if (json) {
+        fprintf(stream, "{\"wall_ms\":%.3f,\"phases_ms\":{", wall_seconds * 1e3);
+        for (i = 0; i < STATS_PHASE_COUNT; i++) {
+            fprintf(stream, "%s\"%s\":%.3f", i ? "," : "", phase_names[i], stats->seconds[i] * 1e3);
+        }
+        fprintf(stream, "},\"counters\":{\"files\":%lu,\"cache_hits\":%lu,\"lines_read\":%lu,"
+                        "\"macros_defined\":%lu,\"macro_expansions\":%lu,\"bytes_expanded\":%lu,"
+                        "\"symbols_inserted\":%lu,\"symbol_lookups\":%lu,\"average_probe_length\":%.3f,"
+                        "\"words_emitted\":%lu,\"fixups\":%lu},",
+                stats->files, stats->cache_hits, stats->lines_read, stats->macros_defined,
+                stats->macro_expansions, stats->bytes_expanded, stats->symbols_inserted,
+                stats->symbol_lookups, probe_length, stats->words_emitted, stats->fixups);
+        fprintf(stream, "\"peak_bytes\":{\"symbols\":%lu,\"macros\":%lu,\"spans\":%lu,"
+                        "\"instructions\":%lu,\"image\":%lu,\"fixups\":%lu,\"output\":%lu}}\n",
+                (unsigned long)stats->peak_symbol_bytes, (unsigned long)stats->peak_macro_bytes,
+                (unsigned long)stats->peak_span_bytes, (unsigned long)stats->peak_instruction_bytes,
+                (unsigned long)stats->peak_image_bytes, (unsigned long)stats->peak_fixup_bytes,
+                (unsigned long)stats->peak_output_bytes);
+        return;
+    }
+
+    fprintf(stream, "Phase times, summed over files (wall %.3f ms):\n", wall_seconds * 1e3);
+    for (i = 0; i < STATS_PHASE_COUNT; i++) {
+        fprintf(stream, "  %-22s %12.3f ms\n", phase_names[i], stats->seconds[i] * 1e3);
+    }
+    fprintf(stream, "Counters:\n");
+    fprintf(stream, "  %-22s %12lu\n", "files", stats->files);
+    fprintf(stream, "  %-22s %12lu\n", "cache_hits", stats->cache_hits);
+    fprintf(stream, "  %-22s %12lu\n", "lines_read", stats->lines_read);
+    fprintf(stream, "  %-22s %12lu\n", "macros_defined", stats->macros_defined);
+    fprintf(stream, "  %-22s %12lu\n", "macro_expansions", stats->macro_expansions);
+    fprintf(stream, "  %-22s %12lu\n", "bytes_expanded", stats->bytes_expanded);
+    fprintf(stream, "  %-22s %12lu\n", "symbols_inserted", stats->symbols_inserted);
+    fprintf(stream, "  %-22s %12lu\n", "symbol_lookups", stats->symbol_lookups);
+    fprintf(stream, "  %-22s %12.3f\n", "average_probe_length", probe_length);
+    fprintf(stream, "  %-22s %12lu\n", "words_emitted", stats->words_emitted);
+    fprintf(stream, "  %-22s %12lu\n", "fixups", stats->fixups);
+    fprintf(stream, "Peak bytes per file:\n");
+    fprintf(stream, "  %-22s %12lu\n", "symbols", (unsigned long)stats->peak_symbol_bytes);
+    fprintf(stream, "  %-22s %12lu\n", "macros", (unsigned long)stats->peak_macro_bytes);
+    fprintf(stream, "  %-22s %12lu\n", "spans", (unsigned long)stats->peak_span_bytes);
+    fprintf(stream, "  %-22s %12lu\n", "instructions", (unsigned long)stats->peak_instruction_bytes);
+    fprintf(stream, "  %-22s %12lu\n", "image", (unsigned long)stats->peak_image_bytes);
+    fprintf(stream, "  %-22s %12lu\n", "fixups", (unsigned long)stats->peak_fixup_bytes);
+    fprintf(stream, "  %-22s %12lu\n", "output", (unsigned long)stats->peak_output_bytes);
+}
@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Phases of assembling a file, in the order they run. All macro
+ * definitions are collected before any call is expanded */
+typedef enum {
+    STATS_MACRO_COLLECTION,
+    STATS_MACRO_EXPANSION,
+    STATS_FIRST_PASS,
+    STATS_ENCODING,
+    STATS_SECOND_PASS,
+    STATS_OUTPUT,
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+/* Timings and counters of one or more assembled files. Every context keeps
+ * one and adds to it after each file; the counters are plain additions done
+ * once per file or per table probe, so they are always collected */
+typedef struct {
+    double seconds[STATS_PHASE_COUNT];  /* Wall time of each phase, summed over files */
+    unsigned long files;
+    unsigned long cache_hits;           /* Files restored from the cache, not timed */
+    unsigned long lines_read;
+    unsigned long macros_defined;
+    unsigned long macro_expansions;
+    unsigned long bytes_expanded;       /* Size of the program after expansion */
+    unsigned long symbols_inserted;
+    unsigned long symbol_lookups;
+    unsigned long symbol_probes;        /* Slots visited by all lookups */
+    unsigned long words_emitted;
+    unsigned long fixups;
+
+    /* Largest size any file needed, in bytes */
+    size_t peak_symbol_bytes;
+    size_t peak_macro_bytes;
+    size_t peak_span_bytes;
+    size_t peak_instruction_bytes;
+    size_t peak_image_bytes;
+    size_t peak_fixup_bytes;
+    size_t peak_output_bytes;
+} AssemblyStats;
+
+void init_stats(AssemblyStats* stats);
+
+/* Seconds since an arbitrary fixed point, for timing phases */
+double stats_clock(void);
+
+/* Add the times and counters of part to total and keep the larger peaks */
+void merge_stats(AssemblyStats* total, const AssemblyStats* part);
+
+/* Print a report, as a table or as a single JSON object */
+void print_stats(const AssemblyStats* stats, double wall_seconds, int json, FILE* stream);
+
+#endif /* STATS_H */
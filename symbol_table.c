@@ -1,53 +1,209 @@
 #include "symbol_table.h"
+#include "hash.h"
 #include <string.h>
-#include <stdio.h>
+#include <stdlib.h>
 
-Symbol symbol_table[MAX_SYMBOLS];
-int symbol_count = 0;
+#define INITIAL_SYMBOL_CAPACITY 64
+#define EMPTY_SLOT (-1)
 
-void add_symbol(const char* name, int address) {
-    if (symbol_count < MAX_SYMBOLS) {
-        strncpy(symbol_table[symbol_count].name, name, MAX_SYMBOL_LENGTH - 1);
-        symbol_table[symbol_count].name[MAX_SYMBOL_LENGTH - 1] = '\0';
-        symbol_table[symbol_count].address = address;
-        symbol_table[symbol_count].is_external = 0;
-        symbol_table[symbol_count].is_entry = 0;
-        symbol_count++;
-    } else {
-        fprintf(stderr, "Error: Symbol table is full\n");
-    }
+static size_t name_length(const char* name);
+static int find_slot(SymbolTable* table, const char* name, size_t length, unsigned int hash);
+static int insert_symbol(SymbolTable* table, int slot, const char* name, size_t length, unsigned int hash);
+static int grow_table(SymbolTable* table);
+
+/* Names are compared on at most MAX_SYMBOL_LENGTH characters, matching what is stored */
+static size_t name_length(const char* name) {
+    size_t length = 0;
+    while (length < MAX_SYMBOL_LENGTH && name[length] != '\0') length++;
+    return length;
 }
 
-int lookup_symbol(const char* name) {
-    int i;
-    for (i = 0; i < symbol_count; i++) {
-        if (strcmp(symbol_table[i].name, name) == 0) {
-            return symbol_table[i].address;
+/* Linear probe for name. Returns the slot holding it, or the empty slot
+ * where it would be inserted. Counts the probe for the statistics */
+static int find_slot(SymbolTable* table, const char* name, size_t length, unsigned int hash) {
+    unsigned int i = hash & table->slot_mask;
+    unsigned long probes = 1;
+    const Symbol* symbol;
+
+    while (table->slots[i].symbol != EMPTY_SLOT) {
+        symbol = &table->symbols[table->slots[i].symbol];
+        if (table->slots[i].hash == hash && memcmp(symbol->name, name, length) == 0 &&
+            symbol->name[length] == '\0') {
+            break;
         }
+        i = (i + 1) & table->slot_mask;
+        probes++;
     }
-    return -1; /* Symbol not found */
+    table->lookups++;
+    table->probes += probes;
+    return (int)i;
 }
 
-void mark_external(const char* name) {
-    int i;
-    for (i = 0; i < symbol_count; i++) {
-        if (strcmp(symbol_table[i].name, name) == 0) {
-            symbol_table[i].is_external = 1;
-            return;
-        }
+/* Double the symbol storage and the index, rehashing from the stored hashes.
+ * The index is kept at most half full so probe sequences stay short */
+static int grow_table(SymbolTable* table) {
+    int new_capacity = table->capacity ? table->capacity * 2 : INITIAL_SYMBOL_CAPACITY;
+    unsigned int new_mask = (unsigned int)new_capacity * 2 - 1;
+    Symbol* new_symbols;
+    SymbolSlot* new_slots;
+    unsigned int i, j;
+
+    new_symbols = realloc(table->symbols, new_capacity * sizeof(Symbol));
+    if (new_symbols == NULL) return 0;
+    table->symbols = new_symbols;
+
+    new_slots = malloc((new_mask + 1) * sizeof(SymbolSlot));
+    if (new_slots == NULL) return 0;
+    for (i = 0; i <= new_mask; i++) {
+        new_slots[i].symbol = EMPTY_SLOT;
+    }
+
+    for (i = 0; i < (unsigned int)table->count; i++) {
+        j = table->symbols[i].hash & new_mask;
+        while (new_slots[j].symbol != EMPTY_SLOT) j = (j + 1) & new_mask;
+        new_slots[j].hash = table->symbols[i].hash;
+        new_slots[j].symbol = (int)i;
     }
-    /* If symbol not found, add it as external */
-    add_symbol(name, 0);
-    symbol_table[symbol_count - 1].is_external = 1;
+
+    free(table->slots);
+    table->slots = new_slots;
+    table->slot_mask = new_mask;
+    table->capacity = new_capacity;
+    return 1;
 }
 
-void mark_entry(const char* name) {
+void init_symbol_table(SymbolTable* table) {
+    table->symbols = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->slots = NULL;
+    table->slot_mask = 0;
+    table->lookups = 0;
+    table->probes = 0;
+}
+
+/* Store a new symbol in an empty slot found by find_slot, the symbol
+ * storage must already have room. Returns the index of the symbol */
+static int insert_symbol(SymbolTable* table, int slot, const char* name, size_t length, unsigned int hash) {
+    Symbol* symbol = &table->symbols[table->count];
+
+    memcpy(symbol->name, name, length);
+    symbol->name[length] = '\0';
+    symbol->hash = hash;
+    symbol->address = 0;
+    symbol->is_defined = 0;
+    symbol->is_external = 0;
+    symbol->is_entry = 0;
+    symbol->entry_line = 0;
+    symbol->is_data = 0;
+
+    table->slots[slot].hash = hash;
+    table->slots[slot].symbol = table->count;
+    return table->count++;
+}
+
+int reference_symbol(SymbolTable* table, const char* name, size_t length) {
+    unsigned int hash;
+    int slot;
+
+    if (length > MAX_SYMBOL_LENGTH) length = MAX_SYMBOL_LENGTH;
+    hash = hash_text(name, length);
+
+    if (table->count == table->capacity && !grow_table(table)) {
+        return -1;
+    }
+
+    slot = find_slot(table, name, length, hash);
+    if (table->slots[slot].symbol != EMPTY_SLOT) {
+        return table->slots[slot].symbol;
+    }
+    return insert_symbol(table, slot, name, length, hash);
+}
+
+int add_symbol(SymbolTable* table, const char* name, int address, int is_data) {
+    int index = reference_symbol(table, name, name_length(name));
+    Symbol* symbol;
+
+    if (index < 0) {
+        return SYMBOL_NO_MEMORY;
+    }
+
+    /* The insertion probe doubles as the duplicate check */
+    symbol = &table->symbols[index];
+    if (symbol->is_defined || symbol->is_external) {
+        return SYMBOL_DUPLICATE;
+    }
+    symbol->address = address;
+    symbol->is_defined = 1;
+    symbol->is_data = is_data;
+    return SYMBOL_ADDED;
+}
+
+int lookup_symbol(SymbolTable* table, const char* name) {
+    size_t length = name_length(name);
+    const Symbol* symbol;
+    int slot;
+
+    if (table->count == 0) return -1;
+
+    slot = find_slot(table, name, length, hash_text(name, length));
+    if (table->slots[slot].symbol == EMPTY_SLOT) {
+        return -1; /* Symbol not found */
+    }
+    symbol = &table->symbols[table->slots[slot].symbol];
+    return (symbol->is_defined || symbol->is_external) ? symbol->address : -1;
+}
+
+int mark_external(SymbolTable* table, const char* name) {
+    int index = reference_symbol(table, name, name_length(name));
+
+    if (index < 0) {
+        return SYMBOL_NO_MEMORY;
+    }
+    if (table->symbols[index].is_defined) {
+        return SYMBOL_DUPLICATE;
+    }
+    table->symbols[index].is_external = 1;
+    return SYMBOL_ADDED;
+}
+
+int mark_entry(SymbolTable* table, const char* name, int line_number) {
+    int index = reference_symbol(table, name, name_length(name));
+
+    if (index < 0) {
+        return 0;
+    }
+    if (!table->symbols[index].is_entry) table->symbols[index].entry_line = line_number;
+    table->symbols[index].is_entry = 1;
+    return 1;
+}
+
+void relocate_data_symbols(SymbolTable* table, int address) {
     int i;
-    for (i = 0; i < symbol_count; i++) {
-        if (strcmp(symbol_table[i].name, name) == 0) {
-            symbol_table[i].is_entry = 1;
-            return;
-        }
+
+    for (i = 0; i < table->count; i++) {
+        if (table->symbols[i].is_data) table->symbols[i].address += address;
     }
-    fprintf(stderr, "Error: Trying to mark non-existent symbol '%s' as entry\n", name);
-}
\ No newline at end of file
+}
+
+void clear_symbol_table(SymbolTable* table) {
+    unsigned int i, j;
+
+    /* Empty only the slots in use, so clearing costs as much as the symbols
+     * added and not the size the index has grown to. Every slot to clear is
+     * known to be present, so the probe does not stop at emptied slots */
+    for (i = 0; i < (unsigned int)table->count; i++) {
+        j = table->symbols[i].hash & table->slot_mask;
+        while (table->slots[j].symbol != (int)i) j = (j + 1) & table->slot_mask;
+        table->slots[j].symbol = EMPTY_SLOT;
+    }
+    table->count = 0;
+    table->lookups = 0;
+    table->probes = 0;
+}
+
+void free_symbol_table(SymbolTable* table) {
+    free(table->symbols);
+    free(table->slots);
+    init_symbol_table(table);
+}
@@ -1,19 +1,73 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
+#include <stddef.h>
+
 #define MAX_SYMBOL_LENGTH 31
-#define MAX_SYMBOLS 1000
 
 typedef struct {
-    char name[MAX_SYMBOL_LENGTH];
+    char name[MAX_SYMBOL_LENGTH + 1];
+    unsigned int hash;   /* Precomputed hash of name, reused when the index grows */
     int address;
+    int is_defined;      /* Defined by a label in this file, not only referenced */
     int is_external;
     int is_entry;
+    int entry_line;      /* Line of the first .entry naming it, for the error if it is not defined */
+    int is_data;         /* Defined on a data line, the address counts from the data segment */
 } Symbol;
 
-void add_symbol(const char* name, int address);
-int lookup_symbol(const char* name);
-void mark_external(const char* name);
-void mark_entry(const char* name);
+/* A slot of the open-addressing index. The hash is kept next to the symbol
+ * index so that most probes are rejected without touching the symbol itself */
+typedef struct {
+    unsigned int hash;
+    int symbol;
+} SymbolSlot;
+
+/* Symbols are stored densely in definition order, the index maps names to them */
+typedef struct {
+    Symbol* symbols;
+    int count;
+    int capacity;
+    SymbolSlot* slots;
+    unsigned int slot_mask; /* slot capacity - 1, capacity is a power of two */
+    unsigned long lookups;  /* Probe sequences run since the table was cleared */
+    unsigned long probes;   /* Slots they visited */
+} SymbolTable;
+
+/* Results of add_symbol */
+#define SYMBOL_ADDED 1
+#define SYMBOL_DUPLICATE 0
+#define SYMBOL_NO_MEMORY (-1)
+
+void init_symbol_table(SymbolTable* table);
+
+/* Define a symbol. A symbol that was only referenced so far becomes defined,
+ * the insertion probe also detects an existing definition. The address of
+ * a data symbol is a DC until relocate_data_symbols */
+int add_symbol(SymbolTable* table, const char* name, int address, int is_data);
+
+/* Get the index of a symbol, adding it as not yet defined if it is unknown.
+ * The name does not need to be null terminated. Returns -1 if out of memory */
+int reference_symbol(SymbolTable* table, const char* name, size_t length);
+
+/* Get the address of a symbol, or -1 if it is not defined */
+int lookup_symbol(SymbolTable* table, const char* name);
+
+/* Mark a symbol as external, adding it if needed.
+ * Returns SYMBOL_DUPLICATE if the file defines it */
+int mark_external(SymbolTable* table, const char* name);
+
+/* Mark a symbol as entry on a line, adding a reference if needed.
+ * Whether it gets defined is checked in the second pass */
+int mark_entry(SymbolTable* table, const char* name, int line_number);
+
+/* Move the data symbols to follow the code, which ends before address */
+void relocate_data_symbols(SymbolTable* table, int address);
+
+/* Remove all symbols but keep the storage for reuse */
+void clear_symbol_table(SymbolTable* table);
+
+/* Release all symbols and the hash index */
+void free_symbol_table(SymbolTable* table);
 
-#endif /* SYMBOL_TABLE_H */
\ No newline at end of file
+#endif /* SYMBOL_TABLE_H */
@@ -0,0 +1,272 @@
+/* Checks that an incremental session gives the same result as assembling
+ * the whole source again. Random edits are applied to a source with
+ * macros, labels, directives and errors, and after every edit
+ * session_result is compared with asm_assemble_buffer on the joined lines.
+ * Usage: incremental_test [sequences] [edits per sequence] */
+
+#include "../incremental.h"
+#include "../assembler_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_SEQUENCES 12
+#define DEFAULT_EDITS 1000
+#define RANDOM_LINES 80
+#define MAX_LINES 300        /* Edits add no lines to a source this long */
+#define MAX_ADDED_LINES 2
+
+/* The source being edited, one allocated string per line */
+typedef struct {
+    char* lines[MAX_LINES + MAX_ADDED_LINES];
+    int count;
+} TestSource;
+
+/* Defined at the start of every sequence. q1 is defined after the random
+ * lines, so a call of it may come before its definition */
+static const char* const macro_lines[] = {
+        "macr m1", "inc r1", "jmp A", "endmacr",
+        "macr p1 a, b", "mov a, b", "m1", "endmacr",
+        "macr n1 x", "p1 x, r3", "q1 x", "inc x", "endmacr"
+};
+static const char* const late_macro_lines[] = {"macr q1 z", "prn z", "endmacr"};
+
+static const char* const calls[] = {
+        "m1", "p1 r1, r2", "p1 #5, B", "p1 A, *r2", "n1 r4", "n1 A", "n1 B", "p1 r1", "n1", "p1 ,", "q1 r5",
+        "L: n1 r1", "n1 r1, r2"
+};
+static const char* const directives[] = {
+        ".data 5, -3, 17", ".data 1", ".string \"ab\"", ".string \"\"", ".data 99999", ".data 3,,4", ".string x",
+        ".entry A", ".entry D1", ".entry S", ".extern Z", ".extern A", ".entry Q", ".data +12 , 8"
+};
+static const char* const labels[] = {"A", "B", "LOOP", "END", "X1", "Y", "D1", "S"};
+static const char* const opcodes[] = {
+        "mov", "cmp", "add", "lea", "clr", "jmp", "bne", "prn", "rts", "stop", "inc", "foo"
+};
+static const char* const sources[] = {"#5", "r1", "*r2", "A", "LOOP", "Q", "#-16384", "#16384"};
+static const char* const destinations[] = {"r3", "*r4", "B", "END", "#1", "Y", "Z"};
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+static unsigned long random_state;
+
+/* xorshift, so a failing sequence can be run again on any platform */
+static unsigned long next_random(void) {
+    random_state ^= (random_state << 13) & 0xFFFFFFFFUL;
+    random_state ^= random_state >> 17;
+    random_state ^= (random_state << 5) & 0xFFFFFFFFUL;
+    return random_state;
+}
+
+static int random_below(int limit) {
+    return (int)(next_random() % (unsigned long)limit);
+}
+
+/* Write a random line into line, mostly valid instructions */
+static void random_line(char* line) {
+    char label[16] = "";
+    const char* opcode;
+    int kind = random_below(20);
+
+    if (kind == 0) {
+        line[0] = '\0';
+    } else if (kind == 1) {
+        strcpy(line, "; comment");
+    } else if (kind == 2 || kind == 3) {
+        strcpy(line, calls[random_below(COUNT(calls))]);
+    } else if (kind == 4 && random_below(8) == 0) {
+        strcpy(line, random_below(2) ? "macr m2" : "endmacr");
+    } else if (kind < 9) {
+        if (random_below(2)) sprintf(label, "%s: ", labels[random_below(COUNT(labels))]);
+        sprintf(line, "%s%s", label, directives[random_below(COUNT(directives))]);
+    } else {
+        if (random_below(3) == 0) sprintf(label, "%s: ", labels[random_below(6)]);
+        opcode = opcodes[random_below(COUNT(opcodes))];
+        if (strcmp(opcode, "mov") == 0 || strcmp(opcode, "cmp") == 0 || strcmp(opcode, "add") == 0) {
+            sprintf(line, "%s%s %s, %s", label, opcode, sources[random_below(COUNT(sources))],
+                    destinations[random_below(5)]);
+        } else if (strcmp(opcode, "lea") == 0) {
+            sprintf(line, "%slea X1, r%d", label, random_below(8));
+        } else if (strcmp(opcode, "rts") == 0 || strcmp(opcode, "stop") == 0) {
+            sprintf(line, "%s%s", label, opcode);
+        } else {
+            sprintf(line, "%s%s %s", label, opcode, destinations[random_below(COUNT(destinations))]);
+        }
+    }
+}
+
+static char* copy_text(const char* text, size_t length) {
+    char* copy = malloc(length + 1);
+
+    if (copy == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/* Join the lines with a newline after each, into an allocated buffer */
+static char* join_lines(const TestSource* source, size_t* length) {
+    size_t size = 1;
+    char* text;
+    char* out;
+    int i;
+
+    for (i = 0; i < source->count; i++) size += strlen(source->lines[i]) + 1;
+    text = out = malloc(size);
+    if (text == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < source->count; i++) {
+        size = strlen(source->lines[i]);
+        memcpy(out, source->lines[i], size);
+        out += size;
+        *out++ = '\n';
+    }
+    *length = (size_t)(out - text);
+    return text;
+}
+
+static void add_line(TestSource* source, const char* line) {
+    source->lines[source->count++] = copy_text(line, strlen(line));
+}
+
+static int references_differ(const SymbolReference* a, const SymbolReference* b, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (a[i].address != b[i].address || strcmp(a[i].name, b[i].name) != 0) return 1;
+    }
+    return 0;
+}
+
+/* Describe the first difference between two results, or return 0 */
+static int results_differ(const AssemblyResult* full, const AssemblyResult* session) {
+    int i;
+
+    if (full->word_count != session->word_count) {
+        printf("%d words, the session has %d\n", full->word_count, session->word_count);
+        return 1;
+    }
+    for (i = 0; i < full->word_count; i++) {
+        if (full->words[i] != session->words[i]) {
+            printf("word %d is %05o, the session has %05o\n", i, full->words[i], session->words[i]);
+            return 1;
+        }
+    }
+    if (full->error_count != session->error_count || full->messages_length != session->messages_length ||
+        memcmp(full->messages, session->messages, full->messages_length) != 0) {
+        printf("messages:\n%.*ssession messages:\n%.*s", (int)full->messages_length, full->messages,
+               (int)session->messages_length, session->messages);
+        return 1;
+    }
+    if (full->entry_count != session->entry_count ||
+        references_differ(full->entries, session->entries, full->entry_count)) {
+        printf("the entries differ\n");
+        return 1;
+    }
+    if (full->external_count != session->external_count ||
+        references_differ(full->externals, session->externals, full->external_count)) {
+        printf("the externals differ\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* Load a random source and apply edits to it, comparing after each one.
+ * Returns 0 on the first difference */
+static int run_sequence(IncrementalSession* session, AssemblerContext* context, int sequence, int edits) {
+    TestSource source;
+    AssemblyResult full, incremental;
+    char added[MAX_ADDED_LINES * 128];
+    char line[128];
+    char* text;
+    size_t length;
+    int first, removed, added_count;
+    int edit, i, j;
+
+    random_state = 2463534242UL + (unsigned long)sequence * 7919UL;
+    source.count = 0;
+    for (i = 0; i < COUNT(macro_lines); i++) add_line(&source, macro_lines[i]);
+    for (i = 0; i < RANDOM_LINES; i++) {
+        if (i == RANDOM_LINES * 3 / 4) {
+            for (j = 0; j < COUNT(late_macro_lines); j++) add_line(&source, late_macro_lines[j]);
+        }
+        random_line(line);
+        add_line(&source, line);
+    }
+
+    text = join_lines(&source, &length);
+    if (!session_load(session, text, length)) {
+        printf("sequence %d: cannot load the source\n", sequence);
+        return 0;
+    }
+    free(text);
+
+    for (edit = 0; edit < edits; edit++) {
+        first = random_below(source.count + 1);
+        removed = first < source.count ? random_below(3) : 0;
+        if (first + removed > source.count) removed = source.count - first;
+        added_count = source.count < MAX_LINES ? random_below(MAX_ADDED_LINES + 1) : 0;
+
+        added[0] = '\0';
+        for (i = 0; i < added_count; i++) {
+            random_line(line);
+            strcat(added, line);
+            strcat(added, "\n");
+        }
+        if (!session_edit(session, first, removed, added, strlen(added))) {
+            printf("sequence %d, edit %d: session_edit failed\n", sequence, edit);
+            return 0;
+        }
+
+        for (i = first; i < first + removed; i++) free(source.lines[i]);
+        memmove(source.lines + first + added_count, source.lines + first + removed,
+                (size_t)(source.count - first - removed) * sizeof(char*));
+        source.count += added_count - removed;
+        text = added;
+        for (i = 0; i < added_count; i++) {
+            length = (size_t)(strchr(text, '\n') - text);
+            source.lines[first + i] = copy_text(text, length);
+            text += length + 1;
+        }
+
+        text = join_lines(&source, &length);
+        asm_assemble_buffer(context, text, length, &full);
+        session_result(session, &incremental);
+        if (results_differ(&full, &incremental)) {
+            printf("sequence %d, edit %d: replacing %d lines at line %d with:\n%ssource:\n%s", sequence, edit,
+                   removed, first + 1, added, text);
+            free(text);
+            return 0;
+        }
+        free(text);
+    }
+
+    for (i = 0; i < source.count; i++) free(source.lines[i]);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    int sequences = argc > 1 ? atoi(argv[1]) : DEFAULT_SEQUENCES;
+    int edits = argc > 2 ? atoi(argv[2]) : DEFAULT_EDITS;
+    IncrementalSession* session = session_create();
+    AssemblerContext* context = asm_context_create();
+    int ok = 1;
+    int i;
+
+    if (session == NULL || context == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (i = 0; i < sequences && ok; i++) ok = run_sequence(session, context, i, edits);
+    if (ok) printf("%d sequences of %d edits match a full run\n", sequences, edits);
+
+    session_destroy(session);
+    asm_context_destroy(context);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/* Checks that expanding the macros of a source in chunks on several
+ * threads gives the same program as expanding it on one. Built against
+ * the assembler with tiny chunks, so that every generated source is split;
+ * the expanded lines, their line numbers and offsets and the messages are
+ * compared. Sources with errors in macro calls and lines are included.
+ * Usage: macro_expansion_test [sources] */
+
+#include "../macros.h"
+#include "../diagnostics.h"
+#include "../source_reader.h"
+#include "random_source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_SOURCES 600
+#define THREADS 4
+#define MAX_SOURCE_LINES 800
+
+/* One expansion of a source, with its own tables */
+typedef struct {
+    MacroTable macros;
+    Diagnostics diagnostics;
+    ExpandedSource program;
+    int thread_count;
+} Expansion;
+
+static void init_expansion(Expansion* expansion, int thread_count) {
+    init_macro_table(&expansion->macros);
+    init_diagnostics(&expansion->diagnostics, "<source>");
+    expansion->program.spans = NULL;
+    expansion->program.count = 0;
+    expansion->program.capacity = 0;
+    expansion->program.line_count = 0;
+    expansion->thread_count = thread_count;
+}
+
+static void free_expansion(Expansion* expansion) {
+    free_macro_table(&expansion->macros);
+    free_diagnostics(&expansion->diagnostics);
+    free_expanded_source(&expansion->program);
+}
+
+/* Expand a source, returns 0 if out of memory */
+static int expand(Expansion* expansion, const char* text, size_t length) {
+    SourceFile source;
+
+    clear_macro_table(&expansion->macros);
+    clear_diagnostics(&expansion->diagnostics);
+    source_from_buffer(&source, text, length);
+    return expand_macros(&expansion->macros, &expansion->diagnostics, &source, &expansion->program,
+                         expansion->thread_count) &&
+           format_diagnostics(&expansion->diagnostics);
+}
+
+/* Describe the first difference between two expansions, or return 0 */
+static int expansions_differ(const Expansion* sequential, const Expansion* parallel) {
+    SpanCursor sequential_cursor, parallel_cursor;
+    LineView sequential_line, parallel_line;
+    int sequential_more, parallel_more;
+    int index = 0;
+
+    if (sequential->diagnostics.length != parallel->diagnostics.length ||
+        memcmp(sequential->diagnostics.text, parallel->diagnostics.text, sequential->diagnostics.length) != 0) {
+        printf("messages:\n%.*smessages in parallel:\n%.*s", (int)sequential->diagnostics.length,
+               sequential->diagnostics.text, (int)parallel->diagnostics.length, parallel->diagnostics.text);
+        return 1;
+    }
+    if (sequential->program.line_count != parallel->program.line_count) {
+        printf("%d source lines, %d in parallel\n", sequential->program.line_count, parallel->program.line_count);
+        return 1;
+    }
+
+    span_cursor_init(&sequential_cursor, &sequential->program);
+    span_cursor_init(&parallel_cursor, &parallel->program);
+    for (;; index++) {
+        sequential_more = span_next_line(&sequential_cursor, &sequential_line);
+        parallel_more = span_next_line(&parallel_cursor, &parallel_line);
+        if (!sequential_more || !parallel_more) break;
+
+        if (sequential_line.length != parallel_line.length ||
+            memcmp(sequential_line.text, parallel_line.text, sequential_line.length) != 0 ||
+            sequential_line.line_number != parallel_line.line_number ||
+            sequential_line.offset != parallel_line.offset) {
+            printf("expanded line %d is \"%.*s\" from line %d, \"%.*s\" from line %d in parallel\n", index + 1,
+                   (int)sequential_line.length, sequential_line.text, sequential_line.line_number,
+                   (int)parallel_line.length, parallel_line.text, parallel_line.line_number);
+            return 1;
+        }
+    }
+    if (sequential_more != parallel_more) {
+        printf("%d expanded lines, %s in parallel\n", index, parallel_more ? "more" : "fewer");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int sources = argc > 1 ? atoi(argv[1]) : DEFAULT_SOURCES;
+    Expansion sequential, parallel;
+    char* text;
+    size_t length;
+    int ok = 1;
+    int i;
+
+    if (EXPANSION_MIN_CHUNK_SIZE > 256) {
+        printf("EXPANSION_MIN_CHUNK_SIZE is %d, build with a small one to split the sources\n",
+               EXPANSION_MIN_CHUNK_SIZE);
+        return 1;
+    }
+    init_expansion(&sequential, 1);
+    init_expansion(&parallel, THREADS);
+
+    for (i = 0; i < sources && ok; i++) {
+        text = random_source((unsigned long)i, 20 + i * 37 % MAX_SOURCE_LINES, i % 3 == 2, &length);
+        if (text == NULL || !expand(&sequential, text, length) || !expand(&parallel, text, length)) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        if (expansions_differ(&sequential, &parallel)) {
+            printf("source %d differs:\n%.*s", i, (int)length, text);
+            ok = 0;
+        }
+        free(text);
+    }
+    if (ok) printf("%d sources expand the same on %d threads\n", sources, THREADS);
+
+    free_expansion(&sequential);
+    free_expansion(&parallel);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/* Checks that the chunked parallel first pass gives the same result as the
+ * sequential passes. Built against the assembler with tiny chunks, so that
+ * every generated source is split even though it is small; each source is
+ * assembled on one thread and on several, and the words, messages, entries
+ * and externals are compared. Sources with errors are included, they make
+ * the parallel pass fall back to the sequential one.
+ * Usage: parallel_pass_test [sources] */
+
+#include "../assembler_api.h"
+#include "../parallel_pass.h"
+#include "random_source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_SOURCES 100
+#define THREADS 4
+#define MAX_SOURCE_LINES 800
+
+static int references_differ(const SymbolReference* a, const SymbolReference* b, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (a[i].address != b[i].address || strcmp(a[i].name, b[i].name) != 0) return 1;
+    }
+    return 0;
+}
+
+/* Describe the first difference between two results, or return 0 */
+static int results_differ(const AssemblyResult* sequential, const AssemblyResult* parallel) {
+    int i;
+
+    if (sequential->word_count != parallel->word_count) {
+        printf("%d words, %d in parallel\n", sequential->word_count, parallel->word_count);
+        return 1;
+    }
+    for (i = 0; i < sequential->word_count; i++) {
+        if (sequential->words[i] != parallel->words[i]) {
+            printf("word %d is %05o, %05o in parallel\n", i, sequential->words[i], parallel->words[i]);
+            return 1;
+        }
+    }
+    if (sequential->error_count != parallel->error_count ||
+        sequential->messages_length != parallel->messages_length ||
+        memcmp(sequential->messages, parallel->messages, sequential->messages_length) != 0) {
+        printf("messages:\n%.*smessages in parallel:\n%.*s", (int)sequential->messages_length,
+               sequential->messages, (int)parallel->messages_length, parallel->messages);
+        return 1;
+    }
+    if (sequential->entry_count != parallel->entry_count ||
+        references_differ(sequential->entries, parallel->entries, sequential->entry_count)) {
+        printf("the entries differ\n");
+        return 1;
+    }
+    if (sequential->external_count != parallel->external_count ||
+        references_differ(sequential->externals, parallel->externals, sequential->external_count)) {
+        printf("the externals differ\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int sources = argc > 1 ? atoi(argv[1]) : DEFAULT_SOURCES;
+    AssemblerContext* sequential = asm_context_create();
+    AssemblerContext* parallel = asm_context_create();
+    AssemblyResult sequential_result, parallel_result;
+    char* text;
+    size_t length;
+    int valid = 0;
+    int ok = 1;
+    int i;
+
+    if (sequential == NULL || parallel == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (PARALLEL_MIN_CHUNK_SIZE > 256) {
+        printf("PARALLEL_MIN_CHUNK_SIZE is %d, build with a small one to split the sources\n",
+               PARALLEL_MIN_CHUNK_SIZE);
+        return 1;
+    }
+    sequential->thread_count = 1;
+    parallel->thread_count = THREADS;
+
+    for (i = 0; i < sources && ok; i++) {
+        text = random_source((unsigned long)i, 20 + i * 37 % MAX_SOURCE_LINES, i % 3 == 2, &length);
+        if (text == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        asm_assemble_buffer(sequential, text, length, &sequential_result);
+        asm_assemble_buffer(parallel, text, length, &parallel_result);
+        if (results_differ(&sequential_result, &parallel_result)) {
+            printf("source %d differs:\n%.*s", i, (int)length, text);
+            ok = 0;
+        }
+        if (sequential_result.error_count == 0) valid++;
+        free(text);
+    }
+    if (ok) printf("%d sources, %d of them valid, give the same result on %d threads\n", sources, valid, THREADS);
+
+    asm_context_destroy(sequential);
+    asm_context_destroy(parallel);
+    return ok ? 0 : 1;
+}
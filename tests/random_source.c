@@ -0,0 +1,241 @@
+#include "random_source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINES_PER_LABEL 6    /* A code label on every this many lines */
+#define LINES_PER_DATA 20    /* A data label for every this many lines */
+#define EXTERNALS 2
+#define MAX_LINE 128
+
+/* The source being built and what it has defined so far */
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+    unsigned long state;
+    int labels;              /* Code labels L0.. the source defines */
+    int data_labels;         /* Data labels D0.., all defined at the end */
+    int macro_sets;          /* Sets of m, p and n macros defined so far */
+    int failed;
+} Generator;
+
+/* Addressing methods as in corpus_gen: i(mmediate) d(irect) x (index) r(egister) */
+typedef struct {
+    const char* name;
+    int operands;
+    const char* sources;
+    const char* destinations;
+} Opcode;
+
+static const Opcode opcodes[] = {
+        {"mov", 2, "idxr", "dxr"}, {"cmp", 2, "idxr", "idxr"}, {"add", 2, "idxr", "dxr"},
+        {"sub", 2, "idxr", "dxr"}, {"lea", 2, "d", "dxr"},     {"clr", 1, "", "dxr"},
+        {"not", 1, "", "dxr"},     {"inc", 1, "", "dxr"},      {"dec", 1, "", "dxr"},
+        {"jmp", 1, "", "dx"},      {"bne", 1, "", "dx"},       {"red", 1, "", "dxr"},
+        {"prn", 1, "", "idxr"},    {"jsr", 1, "", "dx"},       {"rts", 0, "", ""},
+        {"stop", 0, "", ""}
+};
+
+/* Lines with one error each */
+static const char* const bad_lines[] = {
+        "foo r1", "mov r1", "mov #99999, r1", "prn NOWHERE", "lea r1, r2", "cmp r1,, r2", ".data 3,,4",
+        ".data 40000", ".string x", ".entry MISSING", "L0: inc r1", "jmp #3", "inc r1 r2", "p0 r1"
+};
+
+static unsigned long next_random(Generator* generator) {
+    generator->state ^= (generator->state << 13) & 0xFFFFFFFFUL;
+    generator->state ^= generator->state >> 17;
+    generator->state ^= (generator->state << 5) & 0xFFFFFFFFUL;
+    return generator->state;
+}
+
+static int random_below(Generator* generator, int limit) {
+    return (int)(next_random(generator) % (unsigned long)limit);
+}
+
+/* Append a line and its newline */
+static void add_line(Generator* generator, const char* line) {
+    size_t length = strlen(line);
+    size_t capacity = generator->capacity ? generator->capacity : 4096;
+    char* grown;
+
+    if (generator->failed) return;
+    while (generator->length + length + 1 > capacity) capacity *= 2;
+    if (capacity != generator->capacity) {
+        grown = realloc(generator->text, capacity);
+        if (grown == NULL) {
+            generator->failed = 1;
+            return;
+        }
+        generator->text = grown;
+        generator->capacity = capacity;
+    }
+    memcpy(generator->text + generator->length, line, length);
+    generator->text[generator->length + length] = '\n';
+    generator->length += length + 1;
+}
+
+/* Write an operand of an addressing method to out, returns its end */
+static char* write_operand(Generator* generator, char* out, char method) {
+    switch (method) {
+        case 'i': return out + sprintf(out, "#%d", random_below(generator, 1001) - 500);
+        case 'x': return out + sprintf(out, "*r%d", random_below(generator, 8));
+        case 'r': return out + sprintf(out, "r%d", random_below(generator, 8));
+        default: break;
+    }
+    switch (random_below(generator, 6)) {
+        case 0: return out + sprintf(out, "D%d", random_below(generator, generator->data_labels));
+        case 1: return out + sprintf(out, "X%d", random_below(generator, EXTERNALS));
+        default: return out + sprintf(out, "L%d", random_below(generator, generator->labels));
+    }
+}
+
+static char* write_instruction(Generator* generator, char* out) {
+    const Opcode* opcode = &opcodes[random_below(generator, (int)(sizeof(opcodes) / sizeof(opcodes[0])))];
+    const char* methods;
+
+    out += sprintf(out, "%s", opcode->name);
+    if (opcode->operands == 2) {
+        methods = opcode->sources;
+        *out++ = ' ';
+        out = write_operand(generator, out, methods[random_below(generator, (int)strlen(methods))]);
+        *out++ = ',';
+    }
+    if (opcode->operands >= 1) {
+        methods = opcode->destinations;
+        *out++ = ' ';
+        out = write_operand(generator, out, methods[random_below(generator, (int)strlen(methods))]);
+    }
+    *out = '\0';
+    return out;
+}
+
+/* Define set k of macros: m takes no arguments, p two and n one, and n
+ * calls p of the same set and m of the first */
+static void define_macros(Generator* generator, int k) {
+    char line[MAX_LINE];
+
+    sprintf(line, "macr m%d", k);
+    add_line(generator, line);
+    write_instruction(generator, line);
+    add_line(generator, line);
+    add_line(generator, "inc r1");
+    add_line(generator, "endmacr");
+
+    sprintf(line, "macr p%d a, b", k);
+    add_line(generator, line);
+    add_line(generator, "mov a, b");
+    add_line(generator, "  inc b");
+    add_line(generator, "endmacr");
+
+    sprintf(line, "macr n%d x", k);
+    add_line(generator, line);
+    sprintf(line, "p%d x, r%d", k, k + 1);
+    add_line(generator, line);
+    add_line(generator, "m0");
+    add_line(generator, "prn x");
+    add_line(generator, "endmacr");
+
+    generator->macro_sets = k + 1;
+}
+
+/* Write a call of a defined macro, with valid arguments */
+static void write_call(Generator* generator, char* out) {
+    int k = random_below(generator, generator->macro_sets);
+
+    switch (random_below(generator, 3)) {
+        case 0:
+            sprintf(out, "m%d", k);
+            break;
+        case 1:
+            out += sprintf(out, "p%d ", k);
+            out = write_operand(generator, out, "idxr"[random_below(generator, 4)]);
+            out += sprintf(out, ", ");
+            write_operand(generator, out, "dxr"[random_below(generator, 3)]);
+            break;
+        default:
+            out += sprintf(out, "n%d ", k);
+            write_operand(generator, out, "idr"[random_below(generator, 3)]);
+            break;
+    }
+}
+
+char* random_source(unsigned long seed, int line_count, int errors, size_t* length) {
+    Generator generator;
+    char line[MAX_LINE];
+    char* out;
+    int label = 0;
+    int kind;
+    int i;
+
+    generator.text = NULL;
+    generator.length = 0;
+    generator.capacity = 0;
+    generator.state = 2463534242UL ^ (seed * 2654435761UL & 0xFFFFFFFFUL);
+    if (generator.state == 0) generator.state = 1;
+    generator.labels = line_count / LINES_PER_LABEL + 1;
+    generator.data_labels = line_count / LINES_PER_DATA + 1;
+    generator.macro_sets = 0;
+    generator.failed = 0;
+
+    add_line(&generator, "; generated source");
+    for (i = 0; i < EXTERNALS; i++) {
+        sprintf(line, ".extern X%d", i);
+        add_line(&generator, line);
+    }
+    add_line(&generator, ".entry L0");
+    add_line(&generator, ".entry D0");
+    define_macros(&generator, 0);
+
+    for (i = 0; i < line_count; i++) {
+        /* More macros half way, so later calls have more to choose from */
+        if (i == line_count / 2) define_macros(&generator, 1);
+
+        out = line;
+        if (i % LINES_PER_LABEL == 0 && label < generator.labels) {
+            /* A label makes the line an instruction, never a call */
+            out += sprintf(out, "L%d: ", label++);
+            kind = 5;
+        } else {
+            kind = random_below(&generator, 20);
+        }
+
+        if (errors && random_below(&generator, 20) == 0) {
+            strcpy(out, bad_lines[random_below(&generator, (int)(sizeof(bad_lines) / sizeof(bad_lines[0])))]);
+        } else if (kind == 0) {
+            strcpy(out, random_below(&generator, 2) ? "" : "; comment");
+        } else if (kind == 1) {
+            sprintf(out, ".data %d, %d", random_below(&generator, 2001) - 1000, random_below(&generator, 100));
+        } else if (kind == 2) {
+            sprintf(out, ".entry L%d", random_below(&generator, generator.labels));
+        } else if (kind < 5) {
+            write_call(&generator, out);
+        } else {
+            write_instruction(&generator, out);
+        }
+        add_line(&generator, line);
+    }
+
+    /* Labels the loop did not reach, then the data */
+    while (label < generator.labels) {
+        sprintf(line, "L%d: rts", label++);
+        add_line(&generator, line);
+    }
+    add_line(&generator, "stop");
+    for (i = 0; i < generator.data_labels; i++) {
+        if (i % 2 == 0) {
+            sprintf(line, "D%d: .data %d, -%d, +%d", i, i, i * 7, random_below(&generator, 16384));
+        } else {
+            sprintf(line, "D%d: .string \"s%d \"", i, i);
+        }
+        add_line(&generator, line);
+    }
+
+    if (generator.failed) {
+        free(generator.text);
+        return NULL;
+    }
+    *length = generator.length;
+    return generator.text;
+}
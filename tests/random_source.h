@@ -0,0 +1,14 @@
+#ifndef RANDOM_SOURCE_H
+#define RANDOM_SOURCE_H
+
+#include <stddef.h>
+
+/* Generate an assembly source of about line_count lines from a seed, the
+ * same on every platform. It defines plain, parameterized and nested
+ * macros and mixes their calls with labels, every addressing method,
+ * .data, .string, .extern and .entry. With errors set, about one line in
+ * twenty is replaced by a line with an error. Returns an allocated,
+ * newline terminated text, or NULL if out of memory */
+char* random_source(unsigned long seed, int line_count, int errors, size_t* length);
+
+#endif /* RANDOM_SOURCE_H */
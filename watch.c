@@ -0,0 +1,291 @@
+#include "watch.h"
+#include "assembler.h"
+#include "source_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* How long the directory must stay quiet before the changed files are
+ * assembled. Editors and build tools often write a file more than once
+ * on a save, this handles such a burst as one change */
+#ifndef WATCH_DEBOUNCE_MS
+#define WATCH_DEBOUNCE_MS 3
+#endif
+
+/* Reads of a file that keeps changing before it is left for its next write */
+#define WATCH_READ_ATTEMPTS 3
+
+#ifdef __linux__
+
+/* A source file of the directory and the context it is assembled with */
+typedef struct {
+    char* name;                 /* Path of the file, directory included */
+    AssemblerContext context;   /* Reused for every run of the file */
+    char* text;                 /* The source as last read, also reused */
+    size_t text_capacity;
+    int changed;
+} WatchedFile;
+
+/* The files seen so far. Contexts are large, so the files are allocated
+ * one by one and do not move when the list grows */
+typedef struct {
+    const char* directory;
+    const BatchOptions* options;
+    int stats_json;
+    WatchedFile** files;
+    int count;
+    int capacity;
+} WatchList;
+
+static int is_source_name(const char* name);
+static int find_file(const WatchList* list, const char* name);
+static WatchedFile* add_file(WatchList* list, const char* name);
+static void remove_file(WatchList* list, int index);
+static void assemble_changed(WatchList* list);
+static int read_events(int fd, WatchList* list);
+
+/* Only .as files are assembled, the outputs written next to them are not */
+static int is_source_name(const char* name) {
+    size_t length = strlen(name);
+    return length > 3 && strcmp(name + length - 3, ".as") == 0;
+}
+
+/* Get the index of a file by its name in the directory, or -1 */
+static int find_file(const WatchList* list, const char* name) {
+    size_t prefix = strlen(list->directory) + 1;
+    int i;
+
+    for (i = 0; i < list->count; i++) {
+        if (strcmp(list->files[i]->name + prefix, name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Start watching a file of the directory, returns NULL if out of memory */
+static WatchedFile* add_file(WatchList* list, const char* name) {
+    size_t directory_length = strlen(list->directory);
+    WatchedFile** grown;
+    WatchedFile* file;
+    int capacity;
+
+    if (list->count == list->capacity) {
+        capacity = list->capacity ? list->capacity * 2 : 16;
+        grown = realloc(list->files, (size_t)capacity * sizeof(WatchedFile*));
+        if (grown == NULL) return NULL;
+        list->files = grown;
+        list->capacity = capacity;
+    }
+
+    file = malloc(sizeof(WatchedFile));
+    if (file == NULL) return NULL;
+    file->name = malloc(directory_length + strlen(name) + 2);
+    if (file->name == NULL) {
+        free(file);
+        return NULL;
+    }
+    sprintf(file->name, "%s/%s", list->directory, name);
+
+    init_context(&file->context, file->name);
+    file->context.cache_dir = list->options->cache_dir;
+    file->context.thread_count = available_cores();
+    file->context.diagnostics.max_errors = list->options->max_errors;
+    file->text = NULL;
+    file->text_capacity = 0;
+    file->changed = 0;
+
+    list->files[list->count++] = file;
+    return file;
+}
+
+/* Forget a file that was deleted or moved away, with all its buffers */
+static void remove_file(WatchList* list, int index) {
+    WatchedFile* file = list->files[index];
+
+    free_context(&file->context);
+    free(file->text);
+    free(file->name);
+    free(file);
+    list->files[index] = list->files[--list->count];
+}
+
+/* Assemble every changed file and print its messages and how long it took,
+ * then the statistics of all of them if they were asked for.
+ * Files are read rather than mapped: a mapped file truncated while it is
+ * assembled would kill the process with SIGBUS */
+static void assemble_changed(WatchList* list) {
+    AssemblyStats* stats = list->options->stats;
+    WatchedFile* file;
+    double round_start = stats_clock();
+    double start;
+    size_t size = 0;
+    int assembled = 0;
+    int result;
+    int attempt;
+    int ok;
+    int i;
+
+    if (stats != NULL) init_stats(stats);
+    for (i = 0; i < list->count; i++) {
+        file = list->files[i];
+        if (!file->changed) continue;
+        file->changed = 0;
+
+        start = stats_clock();
+        result = SOURCE_CHANGED;
+        for (attempt = 0; attempt < WATCH_READ_ATTEMPTS && result == SOURCE_CHANGED; attempt++) {
+            result = source_read(file->name, &file->text, &file->text_capacity, &size);
+        }
+        if (result == SOURCE_CHANGED) {
+            /* Its writer is not done, closing the file brings it back */
+            printf("%s: skipped, it changed while being read\n", file->name);
+            continue;
+        }
+
+        reset_context(&file->context);
+        if (stats != NULL) init_stats(&file->context.stats);
+        if (result == SOURCE_READ) {
+            ok = assemble_file_contents(&file->context, file->name, file->text, size);
+        } else {
+            report_error(&file->context.diagnostics, 0, "Cannot open file %s", file->name);
+            ok = 0;
+        }
+        flush_diagnostics(&file->context.diagnostics, stderr);
+        printf("%s: %s in %.1f ms\n", file->name, ok ? "assembled" : "failed", (stats_clock() - start) * 1000.0);
+
+        if (stats != NULL) merge_stats(stats, &file->context.stats);
+        assembled++;
+    }
+    if (stats != NULL && assembled > 0) print_stats(stats, stats_clock() - round_start, list->stats_json, stdout);
+    fflush(stdout);
+}
+
+/* Mark the files named by the waiting events as changed.
+ * Returns 0 if the directory cannot be watched any more */
+static int read_events(int fd, WatchList* list) {
+    union {
+        struct inotify_event event;     /* Aligns the buffer for the events */
+        char bytes[4096];
+    } buffer;
+    const struct inotify_event* event;
+    WatchedFile* file;
+    ssize_t length;
+    ssize_t offset;
+    int index;
+    int i;
+
+    length = read(fd, buffer.bytes, sizeof(buffer.bytes));
+    if (length < 0) return errno == EINTR || errno == EAGAIN;
+
+    for (offset = 0; offset < length; offset += (ssize_t)(sizeof(struct inotify_event) + event->len)) {
+        event = (const struct inotify_event*)(buffer.bytes + offset);
+
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) return 0;
+
+        /* Events were lost, any file may have changed */
+        if (event->mask & IN_Q_OVERFLOW) {
+            for (i = 0; i < list->count; i++) list->files[i]->changed = 1;
+            continue;
+        }
+        if (event->len == 0 || !is_source_name(event->name)) continue;
+
+        index = find_file(list, event->name);
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            if (index >= 0) remove_file(list, index);
+            continue;
+        }
+
+        file = index >= 0 ? list->files[index] : add_file(list, event->name);
+        if (file == NULL) {
+            fprintf(stderr, "Error: Out of memory, %s/%s is not watched\n", list->directory, event->name);
+            continue;
+        }
+        file->changed = 1;
+    }
+    return 1;
+}
+
+int watch_directory(const char* directory, const BatchOptions* options, int stats_json) {
+    WatchList list;
+    struct pollfd poller;
+    struct dirent* entry;
+    WatchedFile* file;
+    DIR* listing;
+    int ready;
+    int fd;
+
+    list.directory = directory;
+    list.options = options;
+    list.stats_json = stats_json;
+    list.files = NULL;
+    list.count = 0;
+    list.capacity = 0;
+
+    /* The watch is added before the directory is listed, so that a file
+     * written in between is not missed */
+    fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+                                                       IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        fprintf(stderr, "Error: Cannot watch directory %s\n", directory);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    listing = opendir(directory);
+    if (listing == NULL) {
+        fprintf(stderr, "Error: Cannot read directory %s\n", directory);
+        close(fd);
+        return 1;
+    }
+    while ((entry = readdir(listing)) != NULL) {
+        if (!is_source_name(entry->d_name)) continue;
+        file = add_file(&list, entry->d_name);
+        if (file == NULL) {
+            fprintf(stderr, "Error: Out of memory, %s/%s is not watched\n", directory, entry->d_name);
+            continue;
+        }
+        file->changed = 1;
+    }
+    closedir(listing);
+
+    poller.fd = fd;
+    poller.events = POLLIN;
+    for (;;) {
+        assemble_changed(&list);
+
+        ready = poll(&poller, 1, -1);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+        if (!read_events(fd, &list)) break;
+
+        /* Wait for the burst of writes to end before assembling */
+        while ((ready = poll(&poller, 1, WATCH_DEBOUNCE_MS)) > 0) {
+            if (!read_events(fd, &list)) break;
+        }
+        if (ready > 0) break;
+    }
+
+    fprintf(stderr, "Error: Stopped watching directory %s\n", directory);
+    while (list.count > 0) remove_file(&list, list.count - 1);
+    free(list.files);
+    close(fd);
+    return 1;
+}
+
+#else
+
+int watch_directory(const char* directory, const BatchOptions* options, int stats_json) {
+    (void)options;
+    (void)stats_json;
+    fprintf(stderr, "Error: Cannot watch directory %s, watching is only supported on Linux\n", directory);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "batch.h"
+
+/* Assemble every .as file of a directory, then keep running and assemble
+ * again each file that is written or moved into the directory. Every file
+ * keeps its own context, so the tables and buffers of the last run are
+ * reused. Writes that follow each other closely are handled together.
+ * With options->stats, the statistics of the files assembled together are
+ * printed after them, as JSON if stats_json is set.
+ * Only supported on Linux. Returns only if the directory cannot be
+ * watched any more, with 1 */
+int watch_directory(const char* directory, const BatchOptions* options, int stats_json);
+
+#endif /* WATCH_H */